@@ -15,6 +15,7 @@
 #include "cpu.h"
 #include "tcg/tcg.h"
 #include "exec/exec-all.h"
+#include "sysemu/tcg.h"
 
 void tb_flush(CPUState *cpu)
 {
@@ -23,3 +24,7 @@ void tb_flush(CPUState *cpu)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
 }
+
+/* Set from -accel tcg options in cpus.c, which is built without TCG too */
+bool tb_superblocks;
+bool tcg_direct_ram;
@@ -409,6 +409,9 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
         mmap_unlock();
         /* We add the TB in the virtual pc hash table for the fast lookup */
         atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+    } else {
+        /* Keep the TB's region from being evicted at the next pass */
+        tcg_tb_mark_referenced(tb);
     }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
@@ -638,6 +641,14 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
         return;
     }
 
+    if (!use_icount) {
+        /* A CF_EXEC_COUNT TB has become hot.  */
+        mmap_lock();
+        tb_gen_superblock(cpu, tb);
+        mmap_unlock();
+        return;
+    }
+
     /* Instruction counter expired.  */
     assert(use_icount);
 #ifndef CONFIG_USER_ONLY
@@ -0,0 +1,116 @@
+/*
+ * Direct access to guest RAM for TCG loads
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "exec/address-spaces.h"
+#include "tcg.h"
+#include "trace.h"
+
+/*
+ * The window is the largest RAM section of the system address space.
+ * Loads that use physical addresses and fall inside it can read host
+ * memory directly; everything else, MMIO included, goes through the
+ * TLB as usual.  Stores always use the TLB, which also takes care of
+ * dirty tracking and of invalidating translated code.
+ */
+typedef struct DirectRAMWindow {
+    struct rcu_head rcu;
+    TCGDirectRAM ram;
+} DirectRAMWindow;
+
+bool tcg_direct_ram;
+
+static DirectRAMWindow *direct_ram_window;
+static TCGDirectRAM direct_ram_next;
+
+static void direct_ram_begin(MemoryListener *listener)
+{
+    memset(&direct_ram_next, 0, sizeof(direct_ram_next));
+}
+
+static void direct_ram_region(MemoryListener *listener,
+                              MemoryRegionSection *section)
+{
+    MemoryRegion *mr = section->mr;
+    uint64_t size;
+
+    if (!memory_region_is_ram(mr) || memory_region_is_ram_device(mr)) {
+        return;
+    }
+
+    size = int128_get64(section->size);
+    if (size > direct_ram_next.size) {
+        direct_ram_next.start = section->offset_within_address_space;
+        direct_ram_next.size = size;
+        direct_ram_next.host = (uint8_t *)memory_region_get_ram_ptr(mr) +
+                               section->offset_within_region;
+    }
+}
+
+static void direct_ram_commit(MemoryListener *listener)
+{
+    DirectRAMWindow *old = direct_ram_window;
+    DirectRAMWindow *window = NULL;
+
+    if (direct_ram_next.size < TARGET_PAGE_SIZE) {
+        direct_ram_next.size = 0;
+    }
+    if (old ? !memcmp(&old->ram, &direct_ram_next, sizeof(old->ram))
+            : !direct_ram_next.size) {
+        return;
+    }
+
+    if (direct_ram_next.size) {
+        window = g_new(DirectRAMWindow, 1);
+        window->ram = direct_ram_next;
+    }
+    trace_tcg_direct_ram(direct_ram_next.start, direct_ram_next.size);
+    atomic_rcu_set(&direct_ram_window, window);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+
+    /*
+     * The window is part of the generated code.  TBs that are running
+     * now may still read the old window; its RAM is only freed after an
+     * RCU grace period, and cpu_exec() is an RCU read-side section.
+     */
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+static MemoryListener direct_ram_listener = {
+    .begin = direct_ram_begin,
+    .region_add = direct_ram_region,
+    .region_nop = direct_ram_region,
+    .commit = direct_ram_commit,
+};
+
+void tcg_direct_ram_init(void)
+{
+    memory_listener_register(&direct_ram_listener, &address_space_memory);
+}
+
+/* Copy the current window to @ram; its size is 0 if there is none.  */
+void tcg_direct_ram_get(TCGDirectRAM *ram)
+{
+    DirectRAMWindow *window;
+
+    rcu_read_lock();
+    window = atomic_rcu_read(&direct_ram_window);
+    if (window) {
+        *ram = window->ram;
+    } else {
+        memset(ram, 0, sizeof(*ram));
+    }
+    rcu_read_unlock();
+}
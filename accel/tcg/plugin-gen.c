@@ -0,0 +1,332 @@
+/*
+ * Plugin Support - generation of instrumentation code
+ *
+ * Instrumentation is added once the guest code of a TB has been fully
+ * translated to TCG ops, and before those ops are optimized:
+ *
+ * - While translating, we record for each guest instruction its
+ *   insn_start op, and for each guest memory access the op that performs
+ *   it, together with a copy of the accessed virtual address.
+ *
+ * - At the end of the TB we present the TB to the plugins, which then
+ *   register callbacks and inline operations on the TB, its instructions
+ *   and their memory accesses.
+ *
+ * - The ops that implement those callbacks are then emitted at the end
+ *   of the op list and moved to their insertion point: right after the
+ *   insn_start op of the first instruction for TB callbacks, after the
+ *   insn_start op of each instruction for instruction callbacks, and
+ *   after the memory access op for memory callbacks.
+ *
+ * Since the TB descriptor is filled in before any plugin sees it, no
+ * ops are emitted at all when no plugin asks for instrumentation.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "tcg/tcg.h"
+#include "tcg/tcg-op.h"
+#include "trace/mem.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/translator.h"
+#include "exec/helper-proto.h"
+#include "exec/helper-gen.h"
+#include "exec/plugin-gen.h"
+
+/* a guest memory access performed by the instruction being translated */
+struct plugin_mem_site {
+    TCGOp *op;
+    TCGv_i64 vaddr;
+    uint8_t info;
+};
+
+static struct qemu_plugin_insn *plugin_insn_alloc(void)
+{
+    struct qemu_plugin_insn *insn = g_new0(struct qemu_plugin_insn, 1);
+
+    insn->data = g_byte_array_sized_new(4);
+    insn->mem_sites = g_array_new(false, false,
+                                  sizeof(struct plugin_mem_site));
+    return insn;
+}
+
+static void plugin_cbs_reset(GArray *cbs)
+{
+    if (cbs) {
+        g_array_set_size(cbs, 0);
+    }
+}
+
+static void plugin_insn_reset(struct qemu_plugin_insn *insn)
+{
+    int i, j;
+
+    g_byte_array_set_size(insn->data, 0);
+    g_array_set_size(insn->mem_sites, 0);
+    for (i = 0; i < PLUGIN_N_CB_TYPES; i++) {
+        for (j = 0; j < PLUGIN_N_CB_SUBTYPES; j++) {
+            plugin_cbs_reset(insn->cbs[i][j]);
+        }
+    }
+}
+
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    int i;
+
+    tcg_ctx->plugin_insn = NULL;
+    if (!qemu_plugin_tb_trans_enabled()) {
+        return false;
+    }
+
+    if (ptb == NULL) {
+        ptb = g_new0(struct qemu_plugin_tb, 1);
+        ptb->insns = g_ptr_array_new();
+        tcg_ctx->plugin_tb = ptb;
+    }
+    ptb->vaddr = tb->pc;
+    ptb->n = 0;
+    for (i = 0; i < PLUGIN_N_CB_SUBTYPES; i++) {
+        plugin_cbs_reset(ptb->cbs[i]);
+    }
+    return true;
+}
+
+void plugin_gen_insn_start(CPUState *cpu, const DisasContextBase *db)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    struct qemu_plugin_insn *pinsn;
+
+    /*
+     * The descriptor at index @n may be left over from an instruction
+     * that was started but not translated, e.g. due to a breakpoint.
+     */
+    if (ptb->n < ptb->insns->len) {
+        pinsn = g_ptr_array_index(ptb->insns, ptb->n);
+    } else {
+        pinsn = plugin_insn_alloc();
+        g_ptr_array_add(ptb->insns, pinsn);
+    }
+    plugin_insn_reset(pinsn);
+    pinsn->vaddr = db->pc_next;
+    pinsn->start_op = tcg_last_op();
+    tcg_ctx->plugin_insn = pinsn;
+}
+
+void plugin_gen_insn_end(CPUState *cpu, const DisasContextBase *db)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    struct qemu_plugin_insn *pinsn = tcg_ctx->plugin_insn;
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong pc;
+
+    /* the code was just read by the translator, so this cannot fault */
+    for (pc = pinsn->vaddr; pc < db->pc_next; pc++) {
+        uint8_t byte = cpu_ldub_code(env, pc);
+
+        g_byte_array_append(pinsn->data, &byte, 1);
+    }
+    ptb->n++;
+    tcg_ctx->plugin_insn = NULL;
+}
+
+TCGv_i64 plugin_prep_mem_callbacks(TCGv vaddr)
+{
+    TCGv_i64 copy;
+
+    if (tcg_ctx->plugin_insn == NULL) {
+        return NULL;
+    }
+    /* the access itself may overwrite @vaddr, so keep a copy around */
+    copy = tcg_temp_new_i64();
+    tcg_gen_extu_tl_i64(copy, vaddr);
+    return copy;
+}
+
+void plugin_gen_mem_callbacks(TCGv_i64 vaddr, uint8_t info)
+{
+    struct qemu_plugin_insn *pinsn = tcg_ctx->plugin_insn;
+    struct plugin_mem_site site;
+
+    if (vaddr == NULL) {
+        return;
+    }
+    site.op = tcg_last_op();
+    site.vaddr = vaddr;
+    site.info = info;
+    g_array_append_val(pinsn->mem_sites, site);
+    /*
+     * The copy is only read by the ops that plugin_gen_tb_end() inserts
+     * right after the access, so it can be recycled from now on.
+     */
+    tcg_temp_free_i64(vaddr);
+}
+
+/*
+ * Move the ops emitted after @end so that they follow @pos, preserving
+ * their order.  Returns the last op that was moved, or @pos if none was.
+ */
+static TCGOp *plugin_move_ops(TCGOp *end, TCGOp *pos)
+{
+    TCGOp *op;
+
+    if (pos == end) {
+        return tcg_last_op();
+    }
+    while ((op = QTAILQ_NEXT(end, link)) != NULL) {
+        QTAILQ_REMOVE(&tcg_ctx->ops, op, link);
+        QTAILQ_INSERT_AFTER(&tcg_ctx->ops, pos, op, link);
+        pos = op;
+    }
+    return pos;
+}
+
+static TCGv_i32 gen_cpu_index(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   offsetof(ArchCPU, parent_obj.cpu_index) -
+                   offsetof(ArchCPU, env));
+    return cpu_index;
+}
+
+static void gen_inline_op(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(cb->inline_insn.ptr);
+    TCGv_i64 val = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        tcg_gen_addi_i64(val, val, cb->inline_insn.imm);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_gen_st_i64(val, ptr, 0);
+
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void gen_udata_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i32 cpu_index = gen_cpu_index();
+    TCGv_ptr func = tcg_const_ptr(cb->f.vcpu_udata);
+    TCGv_ptr udata = tcg_const_ptr(cb->userp);
+
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, func, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(func);
+    tcg_temp_free_i32(cpu_index);
+}
+
+static void gen_mem_cb(const struct qemu_plugin_dyn_cb *cb,
+                       const struct plugin_mem_site *site)
+{
+    TCGv_i32 cpu_index = gen_cpu_index();
+    TCGv_i32 info = tcg_const_i32(site->info);
+    TCGv_ptr func = tcg_const_ptr(cb->f.vcpu_mem);
+    TCGv_ptr udata = tcg_const_ptr(cb->userp);
+
+    gen_helper_plugin_vcpu_mem_cb(cpu_index, info, site->vaddr, func, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(func);
+    tcg_temp_free_i32(info);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/* emit the regular callbacks in @cbs and the inline ops in @inl after @pos */
+static TCGOp *inject_cbs(TCGOp *pos, GArray *cbs, GArray *inl)
+{
+    TCGOp *end = tcg_last_op();
+    guint i;
+
+    for (i = 0; inl && i < inl->len; i++) {
+        gen_inline_op(&g_array_index(inl, struct qemu_plugin_dyn_cb, i));
+    }
+    for (i = 0; cbs && i < cbs->len; i++) {
+        gen_udata_cb(&g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
+    }
+    return plugin_move_ops(end, pos);
+}
+
+static bool mem_cb_matches(const struct qemu_plugin_dyn_cb *cb,
+                           const struct plugin_mem_site *site)
+{
+    enum qemu_plugin_mem_rw rw;
+
+    rw = (site->info & TRACE_MEM_ST) ? QEMU_PLUGIN_MEM_W : QEMU_PLUGIN_MEM_R;
+    return cb->rw & rw;
+}
+
+static void inject_mem_cbs(const struct plugin_mem_site *site,
+                           GArray *cbs, GArray *inl)
+{
+    TCGOp *end = tcg_last_op();
+    guint i;
+
+    for (i = 0; inl && i < inl->len; i++) {
+        struct qemu_plugin_dyn_cb *cb;
+
+        cb = &g_array_index(inl, struct qemu_plugin_dyn_cb, i);
+        if (mem_cb_matches(cb, site)) {
+            gen_inline_op(cb);
+        }
+    }
+    for (i = 0; cbs && i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb;
+
+        cb = &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+        if (mem_cb_matches(cb, site)) {
+            gen_mem_cb(cb, site);
+        }
+    }
+    plugin_move_ops(end, site->op);
+}
+
+void plugin_gen_tb_end(CPUState *cpu)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    size_t i;
+    guint j;
+
+    tcg_ctx->plugin_insn = NULL;
+    if (ptb->n == 0) {
+        return;
+    }
+
+    qemu_plugin_tb_trans_cb(cpu, ptb);
+
+    /*
+     * Temporaries freed by the translator may still be live at the
+     * insertion points, so do not let the ops we emit reuse them.
+     */
+    memset(tcg_ctx->free_temps, 0, sizeof(tcg_ctx->free_temps));
+
+    for (i = 0; i < ptb->n; i++) {
+        struct qemu_plugin_insn *pinsn = g_ptr_array_index(ptb->insns, i);
+        TCGOp *pos = pinsn->start_op;
+
+        if (i == 0) {
+            pos = inject_cbs(pos, ptb->cbs[PLUGIN_CB_REGULAR],
+                             ptb->cbs[PLUGIN_CB_INLINE]);
+        }
+        inject_cbs(pos, pinsn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR],
+                   pinsn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE]);
+
+        for (j = 0; j < pinsn->mem_sites->len; j++) {
+            inject_mem_cbs(&g_array_index(pinsn->mem_sites,
+                                          struct plugin_mem_site, j),
+                           pinsn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR],
+                           pinsn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE]);
+        }
+    }
+}
@@ -0,0 +1,757 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Translated code refers to helpers, to the prologue and to its own TB
+ * by absolute or PC-relative addresses.  Instead of relocating it, the
+ * cache puts whole regions of the code buffer back at the address they
+ * had when they were saved.  This only works if QEMU, the code buffer and
+ * the guest mappings are at the same addresses in both runs; the header
+ * of the cache file checks the first two, and each cached mapping the
+ * third.  In practice this means a QEMU executable that is not position
+ * independent, such as the static builds used with binfmt_misc.
+ *
+ * The regions are restored when the program starts, but their TBs are
+ * only made visible when the guest maps the same file at the same address
+ * again, and only if the guest pages still have the same contents.  From
+ * then on, the TBs are invalidated like any other on self-modifying code.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "qemu/crc32c.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/tb-cache.h"
+#include "tcg.h"
+#include "translate-all.h"
+#include "trace.h"
+#include "elf.h"
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+#define TB_CACHE_MAGIC          "QEMUTBC\n"
+#define TB_CACHE_VERSION        1
+#define TB_CACHE_ID_SIZE        40
+#define TB_CACHE_MAX_MAPPINGS   4096
+#define TB_CACHE_MAX_PHDRS      64
+#define TB_CACHE_MAX_NOTES      (64 * KiB)
+
+enum {
+    TB_CACHE_ID_NONE,
+    TB_CACHE_ID_BUILD_ID,       /* GNU build ID of an ELF file */
+    TB_CACHE_ID_STAT,           /* device, inode, size and mtime */
+};
+
+/* Identifies the contents of a file across runs */
+typedef struct TBCacheFileId {
+    uint32_t kind;
+    uint32_t len;
+    uint8_t data[TB_CACHE_ID_SIZE];
+} TBCacheFileId;
+
+/* An executable file mapping in the guest address space */
+typedef struct TBCacheMapping {
+    TBCacheFileId id;
+    uint64_t offset;            /* file offset of @start */
+    uint64_t start;
+    uint64_t len;
+} TBCacheMapping;
+
+/* What must not change for the cached code to be valid */
+typedef struct TBCacheKey {
+    TBCacheFileId qemu_id;
+    TBCacheFileId exec_id;
+    char cpu_type[64];
+    uint64_t guest_base;
+    uint64_t prologue;          /* host address of the prologue */
+    uint64_t prologue_size;
+} TBCacheKey;
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_mappings;
+    uint32_t nb_regions;
+    uint32_t nb_tbs;
+    TBCacheKey key;
+} TBCacheHeader;
+
+typedef struct TBCacheRegion {
+    uint64_t index;
+    uint64_t used;              /* bytes of code at the start of the region */
+    uint64_t current;           /* region was being filled up */
+} TBCacheRegion;
+
+typedef struct TBCacheEntry {
+    uint64_t tb;                /* host address of the TranslationBlock */
+    uint32_t crc[2];            /* of the guest pages in tb->page_addr[] */
+    uint32_t mapping;           /* index of the mapping with the pages */
+    uint32_t reserved;
+} TBCacheEntry;
+
+/*
+ * The cache file is:
+ *
+ *   TBCacheHeader
+ *   the prologue, TBCacheKey.prologue_size bytes
+ *   TBCacheMapping[nb_mappings]
+ *   TBCacheRegion[nb_regions]
+ *   TBCacheEntry[nb_tbs]
+ *   the contents of each region, TBCacheRegion.used bytes
+ *
+ * It is only valid for the same host and QEMU executable, so everything is
+ * in host byte order.
+ */
+
+static struct {
+    char *dir;
+    char *path;                 /* NULL if the cache is disabled */
+    TBCacheKey key;
+    bool loaded;
+    size_t code_size;           /* tcg_code_size() when loaded or saved */
+
+    /* TBCacheMapping, tracked since tb_cache_init() */
+    GArray *mappings;
+
+    /* From the cache file; entries are freed once linked or discarded */
+    TBCacheMapping *cached_mappings;
+    GArray **cached_tbs;        /* of TBCacheEntry, for each mapping */
+    uint32_t nb_cached_mappings;
+} tb_cache;
+
+static uint64_t elf_read(const uint8_t *p, int size, bool be)
+{
+    uint64_t val = 0;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        val |= (uint64_t)p[be ? size - 1 - i : i] << (i * 8);
+    }
+    return val;
+}
+
+static bool tb_cache_find_build_id(const uint8_t *notes, size_t size, bool be,
+                                   TBCacheFileId *id)
+{
+    size_t pos = 0;
+
+    while (pos + 12 <= size) {
+        uint32_t namesz = elf_read(notes + pos, 4, be);
+        uint32_t descsz = elf_read(notes + pos + 4, 4, be);
+        uint32_t type = elf_read(notes + pos + 8, 4, be);
+        size_t name = pos + 12;
+        size_t desc;
+
+        if (namesz > size || descsz > size) {
+            break;
+        }
+        desc = name + ROUND_UP(namesz, 4);
+        if (desc + descsz > size) {
+            break;
+        }
+        if (type == NT_GNU_BUILD_ID && namesz == 4 && descsz > 0 &&
+            memcmp(notes + name, "GNU", 4) == 0) {
+            id->kind = TB_CACHE_ID_BUILD_ID;
+            id->len = MIN(descsz, TB_CACHE_ID_SIZE);
+            memcpy(id->data, notes + desc, id->len);
+            return true;
+        }
+        pos = desc + ROUND_UP(descsz, 4);
+    }
+    return false;
+}
+
+/* Look for a build ID note in an ELF file of either class and byte order */
+static bool tb_cache_read_build_id(int fd, TBCacheFileId *id)
+{
+    uint8_t ehdr[sizeof(Elf64_Ehdr)];
+    uint8_t phdr[sizeof(Elf64_Phdr)];
+    uint64_t phoff, offset, size;
+    unsigned int phentsize, phnum, i;
+    size_t phdr_size;
+    bool is64, be;
+
+    if (pread(fd, ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+        memcmp(ehdr, ELFMAG, SELFMAG) != 0) {
+        return false;
+    }
+    is64 = ehdr[EI_CLASS] == ELFCLASS64;
+    be = ehdr[EI_DATA] == ELFDATA2MSB;
+    if (is64) {
+        phoff = elf_read(ehdr + offsetof(Elf64_Ehdr, e_phoff), 8, be);
+        phentsize = elf_read(ehdr + offsetof(Elf64_Ehdr, e_phentsize), 2, be);
+        phnum = elf_read(ehdr + offsetof(Elf64_Ehdr, e_phnum), 2, be);
+        phdr_size = sizeof(Elf64_Phdr);
+    } else {
+        phoff = elf_read(ehdr + offsetof(Elf32_Ehdr, e_phoff), 4, be);
+        phentsize = elf_read(ehdr + offsetof(Elf32_Ehdr, e_phentsize), 2, be);
+        phnum = elf_read(ehdr + offsetof(Elf32_Ehdr, e_phnum), 2, be);
+        phdr_size = sizeof(Elf32_Phdr);
+    }
+    if (phentsize < phdr_size) {
+        return false;
+    }
+
+    for (i = 0; i < MIN(phnum, TB_CACHE_MAX_PHDRS); i++) {
+        uint8_t *notes;
+        bool found;
+
+        if (pread(fd, phdr, phdr_size, phoff + i * phentsize) != phdr_size) {
+            return false;
+        }
+        if (is64) {
+            if (elf_read(phdr + offsetof(Elf64_Phdr, p_type), 4, be) !=
+                PT_NOTE) {
+                continue;
+            }
+            offset = elf_read(phdr + offsetof(Elf64_Phdr, p_offset), 8, be);
+            size = elf_read(phdr + offsetof(Elf64_Phdr, p_filesz), 8, be);
+        } else {
+            if (elf_read(phdr + offsetof(Elf32_Phdr, p_type), 4, be) !=
+                PT_NOTE) {
+                continue;
+            }
+            offset = elf_read(phdr + offsetof(Elf32_Phdr, p_offset), 4, be);
+            size = elf_read(phdr + offsetof(Elf32_Phdr, p_filesz), 4, be);
+        }
+        if (size > TB_CACHE_MAX_NOTES) {
+            continue;
+        }
+
+        notes = g_malloc(size);
+        found = pread(fd, notes, size, offset) == size &&
+                tb_cache_find_build_id(notes, size, be, id);
+        g_free(notes);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tb_cache_file_id(int fd, TBCacheFileId *id)
+{
+    struct stat st;
+
+    memset(id, 0, sizeof(*id));
+    if (tb_cache_read_build_id(fd, id)) {
+        return;
+    }
+    if (fstat(fd, &st) == 0) {
+        uint64_t data[] = {
+            st.st_dev, st.st_ino, st.st_size,
+            st.st_mtim.tv_sec, st.st_mtim.tv_nsec
+        };
+
+        QEMU_BUILD_BUG_ON(sizeof(data) > TB_CACHE_ID_SIZE);
+        id->kind = TB_CACHE_ID_STAT;
+        id->len = sizeof(data);
+        memcpy(id->data, data, sizeof(data));
+    }
+}
+
+static char *tb_cache_file_name(void)
+{
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+    TBCacheKey *key = &tb_cache.key;
+    char *path;
+
+    g_checksum_update(sum, (const guchar *)&key->qemu_id,
+                      sizeof(key->qemu_id));
+    g_checksum_update(sum, (const guchar *)&key->exec_id,
+                      sizeof(key->exec_id));
+    g_checksum_update(sum, (const guchar *)key->cpu_type,
+                      sizeof(key->cpu_type));
+    path = g_strdup_printf("%s/%s-%s.tbc", tb_cache.dir, TARGET_NAME,
+                           g_checksum_get_string(sum));
+    g_checksum_free(sum);
+    return path;
+}
+
+void tb_cache_init(const char *dir, int exec_fd, const char *cpu_type)
+{
+    TBCacheKey *key = &tb_cache.key;
+    int fd;
+
+    fd = open("/proc/self/exe", O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    tb_cache_file_id(fd, &key->qemu_id);
+    close(fd);
+    tb_cache_file_id(exec_fd, &key->exec_id);
+    if (key->qemu_id.kind == TB_CACHE_ID_NONE ||
+        key->exec_id.kind == TB_CACHE_ID_NONE) {
+        return;
+    }
+    pstrcpy(key->cpu_type, sizeof(key->cpu_type), cpu_type);
+
+    tb_cache.dir = g_strdup(dir);
+    tb_cache.path = tb_cache_file_name();
+    tb_cache.mappings = g_array_new(false, false, sizeof(TBCacheMapping));
+}
+
+static bool tb_cache_page_crc(tb_page_addr_t page, uint32_t *crc)
+{
+    if (!(page_get_flags(page) & PAGE_READ)) {
+        return false;
+    }
+    *crc = crc32c(0xffffffff, g2h(page), TARGET_PAGE_SIZE);
+    return true;
+}
+
+/* Does @m map the same file range as @c did, at the same address? */
+static bool tb_cache_mapping_covers(const TBCacheMapping *m,
+                                    const TBCacheMapping *c)
+{
+    return memcmp(&m->id, &c->id, sizeof(m->id)) == 0 &&
+           c->start >= m->start &&
+           c->start + c->len <= m->start + m->len &&
+           c->offset - m->offset == c->start - m->start;
+}
+
+static bool tb_cache_page_in(const TBCacheMapping *m, tb_page_addr_t page)
+{
+    return page >= m->start && page - m->start < m->len;
+}
+
+/* Make visible the cached TBs of the mappings that @m covers */
+static void tb_cache_link(const TBCacheMapping *m)
+{
+    uint32_t i, j;
+
+    for (j = 0; j < tb_cache.nb_cached_mappings; j++) {
+        const TBCacheMapping *c = &tb_cache.cached_mappings[j];
+        GArray *tbs = tb_cache.cached_tbs[j];
+        unsigned int linked = 0;
+
+        if (!tbs || !tb_cache_mapping_covers(m, c)) {
+            continue;
+        }
+        for (i = 0; i < tbs->len; i++) {
+            TBCacheEntry *e = &g_array_index(tbs, TBCacheEntry, i);
+            TranslationBlock *tb = (TranslationBlock *)(uintptr_t)e->tb;
+            uint32_t crc;
+
+            if (!tb_cache_page_in(c, tb->page_addr[0]) ||
+                !tb_cache_page_crc(tb->page_addr[0], &crc) ||
+                crc != e->crc[0]) {
+                continue;
+            }
+            if (tb->page_addr[1] != -1 &&
+                (!tb_cache_page_in(c, tb->page_addr[1]) ||
+                 !tb_cache_page_crc(tb->page_addr[1], &crc) ||
+                 crc != e->crc[1])) {
+                continue;
+            }
+            linked += tb_link_cached(tb);
+        }
+        trace_tb_cache_link(c->start, c->len, tbs->len, linked);
+        g_array_free(tbs, true);
+        tb_cache.cached_tbs[j] = NULL;
+    }
+}
+
+void tb_cache_discard(void)
+{
+    uint32_t j;
+
+    for (j = 0; j < tb_cache.nb_cached_mappings; j++) {
+        if (tb_cache.cached_tbs[j]) {
+            g_array_free(tb_cache.cached_tbs[j], true);
+        }
+    }
+    g_free(tb_cache.cached_tbs);
+    g_free(tb_cache.cached_mappings);
+    tb_cache.cached_tbs = NULL;
+    tb_cache.cached_mappings = NULL;
+    tb_cache.nb_cached_mappings = 0;
+}
+
+void tb_cache_unmap(target_ulong start, target_ulong len)
+{
+    uint64_t end = (uint64_t)start + len;
+    guint i = 0;
+
+    if (!tb_cache.path) {
+        return;
+    }
+    while (i < tb_cache.mappings->len) {
+        TBCacheMapping *m = &g_array_index(tb_cache.mappings,
+                                           TBCacheMapping, i);
+        uint64_t m_end = m->start + m->len;
+
+        if (m_end <= start || m->start >= end) {
+            i++;
+            continue;
+        }
+        if (m_end > end) {
+            /* keep the part after the range */
+            TBCacheMapping tail = *m;
+
+            tail.offset += end - m->start;
+            tail.start = end;
+            tail.len = m_end - end;
+            g_array_append_val(tb_cache.mappings, tail);
+            m = &g_array_index(tb_cache.mappings, TBCacheMapping, i);
+        }
+        if (m->start < start) {
+            /* keep the part before the range */
+            m->len = start - m->start;
+            i++;
+        } else {
+            g_array_remove_index_fast(tb_cache.mappings, i);
+        }
+    }
+}
+
+void tb_cache_map(target_ulong start, target_ulong len, int prot, int fd,
+                  uint64_t offset)
+{
+    TBCacheMapping m = {
+        .offset = offset,
+        .start = start,
+        .len = len,
+    };
+
+    if (!tb_cache.path) {
+        return;
+    }
+    tb_cache_unmap(start, len);
+    if (fd < 0 || !(prot & PROT_EXEC)) {
+        return;
+    }
+    tb_cache_file_id(fd, &m.id);
+    if (m.id.kind == TB_CACHE_ID_NONE) {
+        return;
+    }
+    g_array_append_val(tb_cache.mappings, m);
+    if (tb_cache.loaded) {
+        tb_cache_link(&m);
+    }
+}
+
+static void tb_cache_init_key(void)
+{
+    TBCacheKey *key = &tb_cache.key;
+    void *start;
+    bool current;
+
+    /* the prologue is right before the first region */
+    tcg_region_code_size(0, &start, &current);
+    key->guest_base = guest_base;
+    key->prologue = (uintptr_t)tcg_ctx->code_gen_prologue;
+    key->prologue_size = start - tcg_ctx->code_gen_prologue;
+}
+
+static bool tb_cache_pread(int fd, void *buf, size_t len, off_t *pos)
+{
+    if (pread(fd, buf, len, *pos) != len) {
+        return false;
+    }
+    *pos += len;
+    return true;
+}
+
+/* Is the whole of @tb within @len bytes at @start? */
+static bool tb_cache_tb_in(TranslationBlock *tb, void *start, size_t len)
+{
+    void *end = start + len;
+
+    return (void *)tb >= start && (void *)(tb + 1) <= end &&
+           (void *)tb->tc.ptr >= (void *)(tb + 1) &&
+           (void *)tb->tc.ptr + tb->tc.size <= end;
+}
+
+static bool tb_cache_read(int fd)
+{
+    TBCacheHeader h;
+    TBCacheMapping *mappings = NULL;
+    TBCacheRegion *regions = NULL;
+    TBCacheEntry *entries = NULL;
+    void **starts = NULL;
+    void *prologue = NULL;
+    struct stat st;
+    off_t pos = 0;
+    bool ret = false;
+    uint32_t i, j;
+
+    /* the cache holds code that is run as is */
+    if (fstat(fd, &st) < 0 || st.st_uid != getuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        return false;
+    }
+
+    if (!tb_cache_pread(fd, &h, sizeof(h), &pos) ||
+        memcmp(h.magic, TB_CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != TB_CACHE_VERSION ||
+        memcmp(&h.key, &tb_cache.key, sizeof(h.key)) != 0 ||
+        h.nb_mappings > TB_CACHE_MAX_MAPPINGS ||
+        h.nb_regions > tcg_nb_regions() ||
+        h.nb_tbs > st.st_size / sizeof(TBCacheEntry)) {
+        return false;
+    }
+
+    prologue = g_malloc(h.key.prologue_size);
+    mappings = g_new(TBCacheMapping, h.nb_mappings);
+    regions = g_new(TBCacheRegion, h.nb_regions);
+    entries = g_new(TBCacheEntry, h.nb_tbs);
+    starts = g_new0(void *, h.nb_regions);
+    if (!tb_cache_pread(fd, prologue, h.key.prologue_size, &pos) ||
+        memcmp(prologue, tcg_ctx->code_gen_prologue,
+               h.key.prologue_size) != 0 ||
+        !tb_cache_pread(fd, mappings, h.nb_mappings * sizeof(*mappings),
+                        &pos) ||
+        !tb_cache_pread(fd, regions, h.nb_regions * sizeof(*regions), &pos) ||
+        !tb_cache_pread(fd, entries, h.nb_tbs * sizeof(*entries), &pos)) {
+        goto out;
+    }
+
+    for (i = 0; i < h.nb_regions; i++) {
+        starts[i] = tcg_region_restore(regions[i].index, regions[i].used,
+                                       regions[i].current);
+        if (!starts[i]) {
+            pos += regions[i].used;
+            continue;
+        }
+        if (!tb_cache_pread(fd, starts[i], regions[i].used, &pos)) {
+            goto out;
+        }
+        flush_icache_range((uintptr_t)starts[i],
+                           (uintptr_t)starts[i] + regions[i].used);
+    }
+
+    tb_cache.cached_tbs = g_new0(GArray *, h.nb_mappings);
+    for (i = 0; i < h.nb_tbs; i++) {
+        TBCacheEntry *e = &entries[i];
+        TranslationBlock *tb = (TranslationBlock *)(uintptr_t)e->tb;
+
+        if (e->mapping >= h.nb_mappings) {
+            continue;
+        }
+        for (j = 0; j < h.nb_regions; j++) {
+            if (starts[j] && tb_cache_tb_in(tb, starts[j], regions[j].used)) {
+                break;
+            }
+        }
+        if (j == h.nb_regions) {
+            continue;
+        }
+        if (!tb_cache.cached_tbs[e->mapping]) {
+            tb_cache.cached_tbs[e->mapping] =
+                g_array_new(false, false, sizeof(TBCacheEntry));
+        }
+        g_array_append_val(tb_cache.cached_tbs[e->mapping], *e);
+    }
+    tb_cache.cached_mappings = mappings;
+    tb_cache.nb_cached_mappings = h.nb_mappings;
+    mappings = NULL;
+    ret = true;
+
+ out:
+    g_free(prologue);
+    g_free(mappings);
+    g_free(regions);
+    g_free(entries);
+    g_free(starts);
+    return ret;
+}
+
+void tb_cache_load(void)
+{
+    guint i;
+    int fd;
+
+    if (!tb_cache.path) {
+        return;
+    }
+
+    mmap_lock();
+    tb_cache_init_key();
+    tb_cache.loaded = true;
+    fd = open(tb_cache.path, O_RDONLY);
+    if (fd >= 0) {
+        if (tb_cache_read(fd)) {
+            trace_tb_cache_load(tb_cache.path, tb_cache.nb_cached_mappings);
+            for (i = 0; i < tb_cache.mappings->len; i++) {
+                tb_cache_link(&g_array_index(tb_cache.mappings,
+                                             TBCacheMapping, i));
+            }
+        } else {
+            tb_cache_discard();
+        }
+        close(fd);
+    }
+    tb_cache.code_size = tcg_code_size();
+    mmap_unlock();
+}
+
+typedef struct TBCacheSaveState {
+    GArray *entries;
+    GHashTable *crcs;
+} TBCacheSaveState;
+
+static int tb_cache_find_mapping(tb_page_addr_t page)
+{
+    guint i;
+
+    for (i = 0; i < tb_cache.mappings->len; i++) {
+        if (tb_cache_page_in(&g_array_index(tb_cache.mappings,
+                                            TBCacheMapping, i), page)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool tb_cache_save_crc(TBCacheSaveState *s, tb_page_addr_t page,
+                              uint32_t *crc)
+{
+    gint64 key = page;
+    gpointer value;
+
+    if (g_hash_table_lookup_extended(s->crcs, &key, NULL, &value)) {
+        *crc = GPOINTER_TO_UINT(value);
+        return true;
+    }
+    if (!tb_cache_page_crc(page, crc)) {
+        return false;
+    }
+    g_hash_table_insert(s->crcs, g_memdup(&key, sizeof(key)),
+                        GUINT_TO_POINTER(*crc));
+    return true;
+}
+
+static gboolean tb_cache_save_iter(gpointer key, gpointer value,
+                                   gpointer data)
+{
+    TranslationBlock *tb = value;
+    TBCacheSaveState *s = data;
+    TBCacheEntry e = { .tb = (uintptr_t)tb };
+    int m;
+
+    if (tb_cflags(tb) & (CF_INVALID | CF_NOCACHE | CF_HOST_PTR)) {
+        return false;
+    }
+    m = tb_cache_find_mapping(tb->page_addr[0]);
+    if (m < 0 || !tb_cache_save_crc(s, tb->page_addr[0], &e.crc[0])) {
+        return false;
+    }
+    if (tb->page_addr[1] != -1 &&
+        (tb_cache_find_mapping(tb->page_addr[1]) != m ||
+         !tb_cache_save_crc(s, tb->page_addr[1], &e.crc[1]))) {
+        return false;
+    }
+    e.mapping = m;
+    g_array_append_val(s->entries, e);
+    return false;
+}
+
+static bool tb_cache_write(int fd, const void *buf, size_t len)
+{
+    return qemu_write_full(fd, buf, len) == len;
+}
+
+void tb_cache_save(void)
+{
+    TBCacheSaveState s;
+    TBCacheHeader h = {
+        .version = TB_CACHE_VERSION,
+    };
+    GArray *regions;
+    void **starts;
+    size_t size = 0;
+    char *tmp;
+    bool ok;
+    guint i, j;
+    int fd;
+
+    if (!tb_cache.loaded) {
+        return;
+    }
+
+    mmap_lock();
+    if (tcg_code_size() == tb_cache.code_size) {
+        mmap_unlock();
+        return;
+    }
+
+    s.entries = g_array_new(false, false, sizeof(TBCacheEntry));
+    s.crcs = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    tcg_tb_foreach(tb_cache_save_iter, &s);
+
+    /* save the regions that hold the TBs */
+    regions = g_array_new(false, false, sizeof(TBCacheRegion));
+    starts = g_new0(void *, tcg_nb_regions());
+    for (i = 0; i < tcg_nb_regions(); i++) {
+        TBCacheRegion r = { .index = i };
+        void *start;
+        bool current;
+
+        r.used = tcg_region_code_size(i, &start, &current);
+        r.current = current;
+        for (j = 0; r.used && j < s.entries->len; j++) {
+            TBCacheEntry *e = &g_array_index(s.entries, TBCacheEntry, j);
+
+            if (tb_cache_tb_in((TranslationBlock *)(uintptr_t)e->tb,
+                               start, r.used)) {
+                starts[regions->len] = start;
+                g_array_append_val(regions, r);
+                size += r.used;
+                break;
+            }
+        }
+    }
+
+    memcpy(h.magic, TB_CACHE_MAGIC, sizeof(h.magic));
+    h.nb_mappings = tb_cache.mappings->len;
+    h.nb_regions = regions->len;
+    h.nb_tbs = s.entries->len;
+    h.key = tb_cache.key;
+
+    tmp = g_strdup_printf("%s.XXXXXX", tb_cache.path);
+    fd = -1;
+    if (g_mkdir_with_parents(tb_cache.dir, 0700) == 0) {
+        fd = g_mkstemp(tmp);
+    }
+    ok = fd >= 0 &&
+         tb_cache_write(fd, &h, sizeof(h)) &&
+         tb_cache_write(fd, tcg_ctx->code_gen_prologue,
+                        h.key.prologue_size) &&
+         tb_cache_write(fd, tb_cache.mappings->data,
+                        h.nb_mappings * sizeof(TBCacheMapping)) &&
+         tb_cache_write(fd, regions->data,
+                        h.nb_regions * sizeof(TBCacheRegion)) &&
+         tb_cache_write(fd, s.entries->data,
+                        h.nb_tbs * sizeof(TBCacheEntry));
+    for (i = 0; ok && i < regions->len; i++) {
+        ok = tb_cache_write(fd, starts[i],
+                            g_array_index(regions, TBCacheRegion, i).used);
+    }
+    if (fd >= 0) {
+        close(fd);
+        if (ok && rename(tmp, tb_cache.path) == 0) {
+            trace_tb_cache_save(tb_cache.path, h.nb_tbs, size);
+        } else {
+            unlink(tmp);
+        }
+    }
+    tb_cache.code_size = tcg_code_size();
+
+    g_free(tmp);
+    g_free(starts);
+    g_array_free(regions, true);
+    g_array_free(s.entries, true);
+    g_hash_table_destroy(s.crcs);
+    mmap_unlock();
+}
@@ -28,6 +28,7 @@
 #include "sysemu/tcg.h"
 #include "qom/object.h"
 #include "cpu.h"
+#include "tcg.h"
 #include "sysemu/cpus.h"
 #include "qemu/main-loop.h"
 
@@ -62,6 +63,9 @@ static int tcg_init(MachineState *ms)
 {
     tcg_exec_init(tcg_tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
+    if (tcg_direct_ram) {
+        tcg_direct_ram_init();
+    }
     return 0;
 }
 
@@ -28,6 +28,7 @@
 #include "tcg.h"
 #if defined(CONFIG_USER_ONLY)
 #include "qemu.h"
+#include "exec/tb-cache.h"
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
 #include <sys/param.h>
 #if __FreeBSD_version >= 700104
@@ -57,6 +58,7 @@
 #include "exec/log.h"
 #include "sysemu/cpus.h"
 #include "sysemu/tcg.h"
+#include "qemu/plugin.h"
 
 /* #define DEBUG_TB_INVALIDATE */
 /* #define DEBUG_TB_FLUSH */
@@ -100,13 +102,25 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * Bytes of a page that are covered by TBs.  The bitmap is published with
+ * RCU so that writes to the page can be checked against it without
+ * taking the page lock; see tb_invalidate_phys_page_needed().
+ */
+typedef struct PageCodeBitmap {
+    struct rcu_head rcu;
+    unsigned long bits[];
+} PageCodeBitmap;
+#endif
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
     /* in order to optimize self modifying code, we count the number
        of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
+    PageCodeBitmap *code_bitmap;
     unsigned int code_write_count;
 #else
     unsigned long flags;
@@ -214,6 +228,17 @@ TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
+/* build superblocks out of hot chains of TBs, see tb_gen_superblock() */
+bool tb_superblocks;
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Bumped under mmap_lock whenever guest pages change flags or lose their
+ * write protection, so that tb_gen_code() can tell whether the code it
+ * translated without the lock may have changed in the meantime.
+ */
+static unsigned int page_gen;
+#endif
 
 static void page_table_config_init(void)
 {
@@ -1164,7 +1189,10 @@ static TranslationBlock *tb_alloc(target_ulong pc)
 {
     TranslationBlock *tb;
 
-    assert_memory_lock();
+#ifdef CONFIG_USER_ONLY
+    /* contexts borrowed with tcg_ctx_acquire() are not shared */
+    tcg_debug_assert(tcg_ctx != &tcg_init_ctx || have_mmap_lock());
+#endif
 
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(tb == NULL)) {
@@ -1173,13 +1201,31 @@ static TranslationBlock *tb_alloc(target_ulong pc)
     return tb;
 }
 
-/* call with @p->lock held */
+/*
+ * Drop the code bitmap of @p after its TB list has changed.  The write
+ * count is kept, so that the bitmap of a page that is known to receive
+ * writes is rebuilt on the next one.
+ *
+ * call with @p->lock held
+ */
 static inline void invalidate_page_bitmap(PageDesc *p)
 {
     assert_page_locked(p);
 #ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
+    if (p->code_bitmap) {
+        PageCodeBitmap *bitmap = p->code_bitmap;
+
+        atomic_rcu_set(&p->code_bitmap, NULL);
+        g_free_rcu(bitmap, rcu);
+    }
+#endif
+}
+
+/* call with @p->lock held */
+static inline void reset_page_bitmap(PageDesc *p)
+{
+    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
     p->code_write_count = 0;
 #endif
 }
@@ -1198,7 +1244,7 @@ static void page_flush_tb_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
-            invalidate_page_bitmap(pd + i);
+            reset_page_bitmap(pd + i);
             page_unlock(&pd[i]);
         }
     } else {
@@ -1256,6 +1302,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     page_flush_tb();
 
     tcg_region_reset_all();
+#ifdef CONFIG_USER_ONLY
+    tb_cache_discard();
+#endif
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
@@ -1421,11 +1470,14 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
 }
 
 /*
+ * Unlink @tb from the hash table, the page lists, the jump caches and the
+ * other TBs.  Returns false if @tb had already been invalidated.
+ *
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static bool do_tb_phys_remove(TranslationBlock *tb, bool rm_from_page_list)
 {
     CPUState *cpu;
     PageDesc *p;
@@ -1445,7 +1497,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
                      tb->trace_vcpu_dstate);
     if (!(tb->cflags & CF_NOCACHE) &&
         !qht_remove(&tb_ctx.htable, tb, h)) {
-        return;
+        return false;
     }
 
     /* remove the TB from the page list */
@@ -1474,9 +1526,15 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
+    return true;
+}
 
-    atomic_set(&tcg_ctx->tb_phys_invalidate_count,
-               tcg_ctx->tb_phys_invalidate_count + 1);
+static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+{
+    if (do_tb_phys_remove(tb, rm_from_page_list)) {
+        atomic_set(&tcg_ctx->tb_phys_invalidate_count,
+                   tcg_ctx->tb_phys_invalidate_count + 1);
+    }
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
@@ -1499,15 +1557,77 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    CPUState *cpu;
+    uint32_t h;
+
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        page_lock_tb(tb);
+        do_tb_phys_remove(tb, true);
+        page_unlock_tb(tb);
+    }
+
+    /*
+     * A vCPU can cache a TB just before it is invalidated; that is harmless
+     * until the TB's memory is reused, which is about to happen.
+     */
+    h = tb_jmp_cache_hash_func(tb->pc);
+    CPU_FOREACH(cpu) {
+        if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
+            atomic_set(&cpu->tb_jmp_cache[h], NULL);
+        }
+    }
+    return false;
+}
+
+/* evict the oldest translation blocks, or flush them all if that fails */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    size_t n_free;
+
+    mmap_lock();
+    /* A flush requested by another CPU has already made room.  */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+#ifdef CONFIG_USER_ONLY
+    /* cached TBs that are not linked yet may be in the evicted regions */
+    tb_cache_discard();
+#endif
+    n_free = tcg_region_evict(tb_evict_iter, NULL);
+    mmap_unlock();
+
+    if (n_free == 0) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/*
+ * Make room in the code cache for new translation blocks, by evicting
+ * those in the regions that filled up first.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict,
+                          RUN_ON_CPU_HOST_INT(tb_flush_count));
+}
+
 #ifdef CONFIG_SOFTMMU
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
     int n, tb_start, tb_end;
     TranslationBlock *tb;
+    PageCodeBitmap *bitmap;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    bitmap = g_malloc0(sizeof(*bitmap) +
+                       BITS_TO_LONGS(TARGET_PAGE_SIZE) * sizeof(long));
 
     PAGE_FOR_EACH_TB(p, tb, n) {
         /* NOTE: this is subtle as a TB may span two physical pages */
@@ -1523,8 +1643,9 @@ static void build_page_bitmap(PageDesc *p)
             tb_start = 0;
             tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
         }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        bitmap_set(bitmap->bits, tb_start, tb_end - tb_start);
     }
+    atomic_rcu_set(&p->code_bitmap, bitmap);
 }
 #endif
 
@@ -1666,7 +1787,33 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/* Maximum number of TBs merged into a superblock */
+#define SUPERBLOCK_MAX_BLOCKS 8
+
+/*
+ * Superblocks are disabled whenever the TB boundaries matter, or
+ * when chaining is.
+ */
+static bool superblock_allowed(CPUState *cpu, uint32_t cflags)
+{
+    return tb_superblocks &&
+           !(cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE |
+                       CF_USE_ICOUNT)) &&
+           !cpu->singlestep_enabled && !singlestep &&
+           !qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN) &&
+           !qemu_plugin_tb_trans_enabled();
+}
+
+/*
+ * Called with mmap_lock held for user mode emulation.
+ *
+ * In user mode with tcg_translators > 1 the lock is dropped while guest
+ * code is translated into a context borrowed with tcg_ctx_acquire(), and
+ * taken again to make the TB visible; two threads that translate the same
+ * code race to insert it into tb_ctx.htable, and the loser's TB is thrown
+ * away.  If guest pages changed in the meantime, the block is translated
+ * again with the lock held.
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
@@ -1677,12 +1824,22 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+#ifdef CONFIG_USER_ONLY
+    bool parallel = false, retried = false;
+    unsigned int gen = 0;
+#endif
 #ifdef CONFIG_PROFILER
-    TCGProfile *prof = &tcg_ctx->prof;
+    TCGProfile *prof;
     int64_t ti;
 #endif
     assert_memory_lock();
 
+#ifdef CONFIG_USER_ONLY
+ retry:
+#endif
+#ifdef CONFIG_PROFILER
+    prof = &tcg_ctx->prof;
+#endif
     phys_pc = get_page_addr_code(env, pc);
 
     if (phys_pc == -1) {
@@ -1704,13 +1861,33 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if (cpu->singlestep_enabled || singlestep) {
         max_insns = 1;
     }
+    if (superblock_allowed(cpu, cflags)) {
+        cflags |= CF_EXEC_COUNT;
+    }
+
+#ifdef CONFIG_USER_ONLY
+    if (tcg_ctx_pool_enabled() && !(cflags & CF_NOCACHE) && !retried) {
+        parallel = true;
+        gen = atomic_read(&page_gen);
+        mmap_unlock();
+        tcg_ctx_acquire();
+#ifdef CONFIG_PROFILER
+        prof = &tcg_ctx->prof;
+#endif
+    }
+#endif
 
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
-        mmap_unlock();
+        /* eviction or flush must be done */
+        tb_evict(cpu);
+#ifdef CONFIG_USER_ONLY
+        if (!tcg_ctx_release())
+#endif
+        {
+            mmap_unlock();
+        }
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
@@ -1723,6 +1900,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1737,6 +1915,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->cpu = env_cpu(env);
     gen_intermediate_code(cpu, tb, max_insns);
     tcg_ctx->cpu = NULL;
+    if (tcg_ctx->uses_host_ptr) {
+        tb->cflags |= CF_HOST_PTR;
+    }
 
     trace_translate_block(tb, tb->pc, tb->tc.ptr);
 
@@ -1857,6 +2038,22 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tb_reset_jump(tb, 1);
     }
 
+#ifdef CONFIG_USER_ONLY
+    if (parallel) {
+        mmap_lock();
+        if (unlikely(atomic_read(&page_gen) != gen)) {
+            uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+
+            orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+            tcg_ctx_release();
+            parallel = false;
+            retried = true;
+            goto retry;
+        }
+    }
+#endif
+
     /* check next page if needed */
     virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
     phys_page2 = -1;
@@ -1874,12 +2071,331 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
-        return existing_tb;
+        tb = existing_tb;
+    } else {
+        tcg_tb_insert(tb);
     }
-    tcg_tb_insert(tb);
+#ifdef CONFIG_USER_ONLY
+    tcg_ctx_release();
+#endif
     return tb;
 }
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * Make visible a TB whose code the persistent translation cache put back
+ * in the code buffer, at the address where an earlier run generated it.
+ * The fields that describe the code are still valid; those that link
+ * the TB to the rest of the system are not.
+ *
+ * Returns false if the same block of guest code has a TB already.
+ * Called with mmap_lock held.
+ */
+bool tb_link_cached(TranslationBlock *tb)
+{
+    tb->exec_count = 0;
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* the saved code may still jump to TBs of the earlier run */
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    if (tb_link_page(tb, tb->pc, tb->page_addr[1]) != tb) {
+        return false;
+    }
+    tcg_tb_insert(tb);
+    return true;
+}
+#endif
+
+/*
+ * Can @tb follow @blocks[0..n-1] in the superblock that starts at @head?
+ * All the code must be in @head's page, after @head->pc, so that the
+ * superblock can be invalidated like a TB that spans all of it.
+ */
+static bool superblock_can_append(TranslationBlock *head, TranslationBlock *tb,
+                                  TranslationBlock **blocks, int n)
+{
+    int i;
+
+    if ((tb_cflags(tb) & (CF_INVALID | CF_SUPERBLOCK)) ||
+        ((tb_cflags(tb) ^ tb_cflags(head)) & CF_HASH_MASK) ||
+        tb->cs_base != head->cs_base ||
+        tb->flags != head->flags ||
+        tb->trace_vcpu_dstate != head->trace_vcpu_dstate ||
+        tb->page_addr[0] != head->page_addr[0] ||
+        tb->page_addr[1] != -1 ||
+        tb->pc < head->pc ||
+        (tb->pc & TARGET_PAGE_MASK) != (head->pc & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    for (i = 0; i < n; i++) {
+        if (blocks[i] == tb) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Starting from @head, follow the chained jumps towards the TB that ran
+ * most often.  Store the TBs in @blocks and, for each of them but the
+ * last, the exit that leads to the next one in @exits.
+ * Returns the number of TBs.
+ */
+static int superblock_collect(TranslationBlock *head,
+                              TranslationBlock **blocks, int *exits)
+{
+    int insns = head->icount;
+    int n = 1;
+
+    blocks[0] = head;
+    while (n < SUPERBLOCK_MAX_BLOCKS) {
+        TranslationBlock *tb = blocks[n - 1];
+        TranslationBlock *next = NULL;
+        int i, exit = -1;
+
+        for (i = 0; i < 2; i++) {
+            uintptr_t dest = atomic_read(&tb->jmp_dest[i]);
+            TranslationBlock *d = (TranslationBlock *)(dest & ~(uintptr_t)1);
+
+            if (d && !(dest & 1) &&
+                (!next || atomic_read(&d->exec_count) >
+                          atomic_read(&next->exec_count))) {
+                next = d;
+                exit = i;
+            }
+        }
+
+        /*
+         * A loop back to @head is left as a chained jump.  Each block
+         * after the first adds a copy of an insn_start, see below.
+         */
+        if (!next || next == head ||
+            !superblock_can_append(head, next, blocks, n) ||
+            insns + next->icount + n > TCG_MAX_INSNS) {
+            break;
+        }
+        exits[n - 1] = exit;
+        blocks[n++] = next;
+        insns += next->icount;
+    }
+    return n;
+}
+
+/*
+ * Rebuild @head, which has run TB_SUPERBLOCK_THRESHOLD times, together
+ * with the TBs it most often jumps to, as a single TB.
+ *
+ * The blocks are translated one after the other; each block's ops are then
+ * moved to where its predecessor used to jump to it.  The optimizer and
+ * the register allocator therefore see the path through the superblock as
+ * straight-line code, and globals stay in host registers across the former
+ * block boundaries unless a conditional branch is in the way.  Other exits
+ * of the blocks use lookup_and_goto_ptr, except for those of the last
+ * block, which are chained as usual.
+ *
+ * The superblock replaces @head in the hash table.  If it cannot be built,
+ * @head is left alone and not considered again.
+ *
+ * Called with mmap_lock held for user mode emulation.
+ */
+void tb_gen_superblock(CPUState *cpu, TranslationBlock *head)
+{
+    CPUArchState *env = cpu->env_ptr;
+    TranslationBlock *blocks[SUPERBLOCK_MAX_BLOCKS];
+    TranslationBlock scratch[SUPERBLOCK_MAX_BLOCKS];
+    TCGOp *start[SUPERBLOCK_MAX_BLOCKS], *last[SUPERBLOCK_MAX_BLOCKS];
+    TCGOp *splice[SUPERBLOCK_MAX_BLOCKS];
+    int exits[SUPERBLOCK_MAX_BLOCKS];
+    TranslationBlock *tb, *existing_tb;
+    TCGSuperblock sb;
+    tcg_insn_unit *gen_code_buf;
+    int gen_code_size, search_size;
+    target_ulong end;
+    int i, n, icount;
+
+    assert_memory_lock();
+
+    if ((tb_cflags(head) & (CF_INVALID | CF_SUPERBLOCK)) ||
+        !superblock_allowed(cpu, tb_cflags(head)) ||
+        head->page_addr[1] != -1 ||
+        get_page_addr_code(env, head->pc) != head->page_addr[0]) {
+        return;
+    }
+
+    n = superblock_collect(head, blocks, exits);
+    if (n < 2) {
+        return;
+    }
+
+    tb = tb_alloc(head->pc);
+    if (unlikely(!tb)) {
+        /* tb_gen_code will make room */
+        return;
+    }
+
+    gen_code_buf = tcg_ctx->code_gen_ptr;
+    tb->tc.ptr = gen_code_buf;
+    tb->pc = head->pc;
+    tb->cs_base = head->cs_base;
+    tb->flags = head->flags;
+    tb->cflags = (tb_cflags(head) & ~(CF_EXEC_COUNT | CF_INVALID)) |
+                 CF_SUPERBLOCK;
+    tb->trace_vcpu_dstate = head->trace_vcpu_dstate;
+    tb->exec_count = 0;
+
+    tcg_func_start(tcg_ctx);
+    tcg_ctx->cpu = cpu;
+    tcg_ctx->superblock = &sb;
+    sb.tb = tb;
+    end = head->pc;
+    icount = 0;
+
+    for (i = 0; i < n; i++) {
+        TranslationBlock *b = &scratch[i];
+        TCGOp *prev = tcg_last_op();
+
+        /* leave plenty of temps for the remaining blocks */
+        if (tcg_ctx->nb_temps >= TCG_MAX_TEMPS / 2) {
+            goto fail;
+        }
+
+        memset(b, 0, sizeof(*b));
+        b->pc = blocks[i]->pc;
+        b->cs_base = blocks[i]->cs_base;
+        b->flags = blocks[i]->flags;
+        b->cflags = tb_cflags(blocks[i]) & ~(CF_EXEC_COUNT | CF_INVALID);
+        b->trace_vcpu_dstate = blocks[i]->trace_vcpu_dstate;
+
+        sb.block = b;
+        sb.index = i;
+        sb.next_exit = i < n - 1 ? exits[i] : -1;
+        sb.splice = NULL;
+        tcg_ctx->tb_cflags = b->cflags;
+#ifdef CONFIG_DEBUG_TCG
+        tcg_ctx->goto_tb_issue_mask = 0;
+#endif
+        gen_intermediate_code(cpu, b, blocks[i]->icount);
+
+        /* the block must end the same way as when it was chained */
+        if (b->size != blocks[i]->size || b->icount != blocks[i]->icount ||
+            (i < n - 1 && !sb.splice)) {
+            goto fail;
+        }
+        start[i] = prev ? QTAILQ_NEXT(prev, link)
+                        : QTAILQ_FIRST(&tcg_ctx->ops);
+        last[i] = tcg_last_op();
+        splice[i] = sb.splice;
+        end = MAX(end, b->pc + b->size);
+        icount += b->icount;
+    }
+    tcg_ctx->superblock = NULL;
+    tcg_ctx->cpu = NULL;
+
+    for (i = 1; i < n; i++) {
+        TCGOp *pos = splice[i - 1];
+        TCGOp *op = start[i];
+        TCGOp *insn, *copy;
+        bool done;
+
+        do {
+            TCGOp *next = QTAILQ_NEXT(op, link);
+
+            done = op == last[i];
+            QTAILQ_REMOVE(&tcg_ctx->ops, op, link);
+            QTAILQ_INSERT_AFTER(&tcg_ctx->ops, pos, op, link);
+            pos = op;
+            op = next;
+        } while (!done);
+
+        /*
+         * The ops that follow belong to the instruction that jumped to
+         * this block; repeat its insn_start so that they unwind to it.
+         */
+        insn = splice[i - 1];
+        while (insn->opc != INDEX_op_insn_start) {
+            insn = QTAILQ_PREV(insn, link);
+        }
+        copy = tcg_op_insert_after(tcg_ctx, pos, INDEX_op_insn_start);
+        memcpy(copy->args, insn->args, sizeof(copy->args));
+        icount++;
+    }
+
+    tb->size = end - head->pc;
+    tb->icount = icount;
+    trace_translate_superblock(tb, tb->pc, n);
+
+    tb->jmp_reset_offset[0] = TB_JMP_RESET_OFFSET_INVALID;
+    tb->jmp_reset_offset[1] = TB_JMP_RESET_OFFSET_INVALID;
+    tcg_ctx->tb_jmp_reset_offset = tb->jmp_reset_offset;
+    if (TCG_TARGET_HAS_direct_jump) {
+        tcg_ctx->tb_jmp_insn_offset = tb->jmp_target_arg;
+        tcg_ctx->tb_jmp_target_addr = NULL;
+    } else {
+        tcg_ctx->tb_jmp_insn_offset = NULL;
+        tcg_ctx->tb_jmp_target_addr = tb->jmp_target_arg;
+    }
+
+    if (tcg_ctx->uses_host_ptr) {
+        tb->cflags |= CF_HOST_PTR;
+    }
+    gen_code_size = tcg_gen_code(tcg_ctx, tb);
+    if (unlikely(gen_code_size < 0)) {
+        goto fail;
+    }
+    search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
+    if (unlikely(search_size < 0)) {
+        goto fail;
+    }
+    tb->tc.size = gen_code_size;
+
+    atomic_set(&tcg_ctx->code_gen_ptr, (void *)
+        ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
+                 CODE_GEN_ALIGN));
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    /* take over the place of @head */
+    tb_phys_invalidate(head, -1);
+    existing_tb = tb_link_page(tb, head->page_addr[0], -1);
+    if (unlikely(existing_tb != tb)) {
+        /* @head was translated again in the meantime; keep that one */
+        atomic_set(&tcg_ctx->code_gen_ptr, tb);
+        return;
+    }
+    tcg_tb_insert(tb);
+    atomic_inc(&tb_ctx.superblock_count);
+    atomic_add(&tb_ctx.superblock_blocks, n);
+    return;
+
+ fail:
+    tcg_ctx->superblock = NULL;
+    tcg_ctx->cpu = NULL;
+    atomic_set(&tcg_ctx->code_gen_ptr, tb);
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1959,7 +2475,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
-        invalidate_page_bitmap(p);
+        reset_page_bitmap(p);
         tlb_unprotect_code(start);
     }
 #endif
@@ -2037,6 +2553,38 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+/*
+ * Return true if a write of @len bytes at @start may hit a TB, and the
+ * caller has to lock the page and call tb_invalidate_phys_page_fast().
+ * False is only returned if the page has a code bitmap and the bytes
+ * are not covered by it, so writes to the data parts of pages that also
+ * hold code do not take any lock.  A TB that is being added to the page
+ * concurrently clears the bitmap before the page is write-protected
+ * again, like it happens with the lock held.
+ *
+ * len must be <= 8 and start must be a multiple of len.
+ * Called within RCU critical section.
+ */
+bool tb_invalidate_phys_page_needed(tb_page_addr_t start, int len)
+{
+    PageCodeBitmap *bitmap;
+    PageDesc *p;
+    unsigned int nr;
+    unsigned long b;
+
+    p = page_find(start >> TARGET_PAGE_BITS);
+    if (!p) {
+        return false;
+    }
+    bitmap = atomic_rcu_read(&p->code_bitmap);
+    if (!bitmap) {
+        return true;
+    }
+    nr = start & ~TARGET_PAGE_MASK;
+    b = bitmap->bits[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+    return b & ((1 << len) - 1);
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
@@ -2065,7 +2613,8 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
         unsigned long b;
 
         nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+        b = p->code_bitmap->bits[BIT_WORD(nr)] >>
+            (nr & (BITS_PER_LONG - 1));
         if (b & ((1 << len) - 1)) {
             goto do_invalidate;
         }
@@ -2329,6 +2878,7 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t evict_passes, evict_regions, evict_tbs, evict_spared;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2365,6 +2915,16 @@ void dump_exec_info(void)
                 atomic_read(&tb_ctx.tb_flush_count));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
+    qemu_printf("TB superblocks      %zu (%zu blocks)\n",
+                atomic_read(&tb_ctx.superblock_count),
+                atomic_read(&tb_ctx.superblock_blocks));
+
+    tcg_region_evict_counts(&evict_passes, &evict_regions, &evict_tbs,
+                            &evict_spared);
+    qemu_printf("TB eviction passes  %zu\n", evict_passes);
+    qemu_printf("TB evicted regions  %zu (spared %zu)\n",
+                evict_regions, evict_spared);
+    qemu_printf("TB evicted count    %zu\n", evict_tbs);
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
@@ -2525,6 +3085,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
 #endif
     assert(start < end);
     assert_memory_lock();
+    atomic_set(&page_gen, page_gen + 1);
 
     start = start & TARGET_PAGE_MASK;
     end = TARGET_PAGE_ALIGN(end);
@@ -2646,6 +3207,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
         } else {
             host_start = address & qemu_host_page_mask;
             host_end = host_start + qemu_host_page_size;
+            atomic_set(&page_gen, page_gen + 1);
 
             prot = 0;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
@@ -26,6 +26,7 @@
 struct page_collection *page_collection_lock(tb_page_addr_t start,
                                              tb_page_addr_t end);
 void page_collection_unlock(struct page_collection *set);
+bool tb_invalidate_phys_page_needed(tb_page_addr_t start, int len);
 void tb_invalidate_phys_page_fast(struct page_collection *pages,
                                   tb_page_addr_t start, int len);
 void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
@@ -34,6 +35,7 @@ void tb_check_watchpoint(CPUState *cpu);
 
 #ifdef CONFIG_USER_ONLY
 int page_unprotect(target_ulong address, uintptr_t pc);
+bool tb_link_cached(TranslationBlock *tb);
 #endif
 
 #endif /* TRANSLATE_ALL_H */
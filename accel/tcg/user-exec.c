@@ -108,11 +108,14 @@ static inline int handle_cpu_signal(uintptr_t pc, siginfo_t *info,
          * there's little we can do about that here).  Therefore, do not
          * trigger the unwinder.
          *
-         * Like tb_gen_code, release the memory lock before cpu_loop_exit.
+         * Like tb_gen_code, release the memory lock before cpu_loop_exit,
+         * or the TCG context if the translation did not hold the lock.
          */
         pc = 0;
         access_type = MMU_INST_FETCH;
-        mmap_unlock();
+        if (!tcg_ctx_release()) {
+            mmap_unlock();
+        }
         break;
     }
 
@@ -702,6 +705,34 @@ int cpu_signal_handler(int host_signum, void *pinfo,
 
 /* The softmmu versions of these helpers are in cputlb.c.  */
 
+void *probe_access(CPUArchState *env, target_ulong addr, int size,
+                   MMUAccessType access_type, int mmu_idx, uintptr_t retaddr)
+{
+    int flags;
+
+    g_assert(-(addr | TARGET_PAGE_MASK) >= size);
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        flags = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        /* Pages holding translated code are write-protected.  */
+        flags = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        flags = PAGE_EXEC;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (!guest_addr_valid(addr) || (page_get_flags(addr) & flags) != flags) {
+        return NULL;
+    }
+    return g2h(addr);
+}
+
 /* Do not allow unaligned operations to proceed.  Return the host address.  */
 static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                                int size, uintptr_t retaddr)
@@ -379,6 +379,7 @@ BlockDriverState *bdrv_new(void)
     notifier_with_return_list_init(&bs->before_write_notifiers);
     qemu_co_mutex_init(&bs->reqs_lock);
     qemu_mutex_init(&bs->dirty_bitmap_mutex);
+    qemu_mutex_init(&bs->block_status_cache.lock);
     bs->refcnt = 1;
     bs->aio_context = qemu_get_aio_context();
 
@@ -865,6 +866,28 @@ int bdrv_parse_discard_flags(const char *mode, int *flags)
     return 0;
 }
 
+/**
+ * Set open flags for aio engine
+ *
+ * Return 0 on success, -1 if the engine specified is invalid
+ */
+int bdrv_parse_aio(const char *mode, int *flags)
+{
+    if (!strcmp(mode, "threads")) {
+        /* do nothing, default */
+    } else if (!strcmp(mode, "native")) {
+        *flags |= BDRV_O_NATIVE_AIO;
+#ifdef CONFIG_LINUX_IO_URING
+    } else if (!strcmp(mode, "io_uring")) {
+        *flags |= BDRV_O_IO_URING;
+#endif
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
 /**
  * Set open flags for a given cache mode
  *
@@ -3983,6 +4006,9 @@ void bdrv_reopen_commit(BDRVReopenState *reopen_state)
 
     bdrv_refresh_limits(bs, NULL);
 
+    /* The driver may have switched to different image metadata */
+    bdrv_bsc_invalidate_all(bs);
+
     new_can_write =
         !bdrv_is_read_only(bs) && !(bdrv_get_flags(bs) & BDRV_O_INACTIVE);
     if (!old_can_write && new_can_write && drv->bdrv_reopen_bitmaps_rw) {
@@ -5355,6 +5381,9 @@ static void coroutine_fn bdrv_co_invalidate_cache(BlockDriverState *bs,
     }
     bdrv_set_perm(bs, perm, shared_perm);
 
+    /* the image may have been changed by the migration source */
+    bdrv_bsc_invalidate_all(bs);
+
     if (bs->drv->bdrv_co_invalidate_cache) {
         bs->drv->bdrv_co_invalidate_cache(bs, &local_err);
         if (local_err) {
@@ -6144,6 +6173,8 @@ int bdrv_amend_options(BlockDriverState *bs, QemuOpts *opts,
                        BlockDriverAmendStatusCB *status_cb, void *cb_opaque,
                        Error **errp)
 {
+    int ret;
+
     if (!bs->drv) {
         error_setg(errp, "Node is ejected");
         return -ENOMEDIUM;
@@ -6153,7 +6184,30 @@ int bdrv_amend_options(BlockDriverState *bs, QemuOpts *opts,
                    bs->drv->format_name);
         return -ENOTSUP;
     }
-    return bs->drv->bdrv_amend_options(bs, opts, status_cb, cb_opaque, errp);
+    ret = bs->drv->bdrv_amend_options(bs, opts, status_cb, cb_opaque, errp);
+
+    /* amending can rewrite the image metadata, e.g. on a qcow2 downgrade */
+    bdrv_bsc_invalidate_all(bs);
+    return ret;
+}
+
+/*
+ * Discard all data of @bs, so that all of its clusters read from the
+ * backing file again.  Returns -ENOTSUP if the driver cannot do that.
+ */
+int bdrv_make_empty(BlockDriverState *bs)
+{
+    int ret;
+
+    if (!bs->drv || !bs->drv->bdrv_make_empty) {
+        return -ENOTSUP;
+    }
+
+    ret = bs->drv->bdrv_make_empty(bs);
+
+    /* The driver drops the data without going through the write path */
+    bdrv_bsc_invalidate_all(bs);
+    return ret;
 }
 
 /* This function will be called by the bdrv_recurse_is_first_non_filter method
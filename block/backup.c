@@ -27,10 +27,15 @@
 #include "qemu/error-report.h"
 
 #define BACKUP_CLUSTER_SIZE_DEFAULT (1 << 16)
+#define BACKUP_MAX_WORKERS_DEFAULT 16
+#define BACKUP_MAX_WORKERS_LIMIT 256
+#define BACKUP_MAX_CHUNK_DEFAULT (1 << 20)
+#define BACKUP_MAX_CHUNK_LIMIT (64 << 20)
 
 typedef struct CowRequest {
     int64_t start_byte;
     int64_t end_byte;
+    bool is_write_notifier;
     QLIST_ENTRY(CowRequest) list;
     CoQueue wait_queue; /* coroutines blocked on this request */
 } CowRequest;
@@ -58,36 +63,60 @@ typedef struct BackupBlockJob {
 
     BdrvRequestFlags write_flags;
     bool initializing_bitmap;
+
+    /*
+     * backup_loop() copies up to max_workers chunks at a time in
+     * background coroutines.  The size of the chunks grows from
+     * cluster_size to max_chunk while copying goes well, and shrinks
+     * when guest writes have to wait for a chunk.
+     */
+    int max_workers;
+    int64_t max_chunk;
+    int64_t chunk_size;
+    int workers;
+    int cbw_requests;        /* guest writes waiting for copy-before-write */
+    int worker_ret;          /* first error of a background chunk */
+    bool worker_error_is_read;
+    CoQueue worker_wait;     /* backup_loop() waits here for a free slot */
 } BackupBlockJob;
 
 static const BlockJobDriver backup_job_driver;
 
-/* See if in-flight requests overlap and wait for them to complete */
-static void coroutine_fn wait_for_overlapping_requests(BackupBlockJob *job,
+/*
+ * See if in-flight requests overlap and wait for them to complete.
+ * Return true if any of them was a background copy.
+ */
+static bool coroutine_fn wait_for_overlapping_requests(BackupBlockJob *job,
                                                        int64_t start,
                                                        int64_t end)
 {
     CowRequest *req;
     bool retry;
+    bool waited_background = false;
 
     do {
         retry = false;
         QLIST_FOREACH(req, &job->inflight_reqs, list) {
             if (end > req->start_byte && start < req->end_byte) {
+                waited_background |= !req->is_write_notifier;
                 qemu_co_queue_wait(&req->wait_queue, NULL);
                 retry = true;
                 break;
             }
         }
     } while (retry);
+
+    return waited_background;
 }
 
 /* Keep track of an in-flight request */
 static void cow_request_begin(CowRequest *req, BackupBlockJob *job,
-                              int64_t start, int64_t end)
+                              int64_t start, int64_t end,
+                              bool is_write_notifier)
 {
     req->start_byte = start;
     req->end_byte = end;
+    req->is_write_notifier = is_write_notifier;
     qemu_co_queue_init(&req->wait_queue);
     QLIST_INSERT_HEAD(&job->inflight_reqs, req, list);
 }
@@ -99,25 +128,29 @@ static void cow_request_end(CowRequest *req)
     qemu_co_queue_restart_all(&req->wait_queue);
 }
 
-/* Copy range to target with a bounce buffer and return the bytes copied. If
- * error occurred, return a negative error number */
+/* Copy range to target with a bounce buffer of @buf_size bytes and return
+ * the bytes copied. If error occurred, return a negative error number */
 static int coroutine_fn backup_cow_with_bounce_buffer(BackupBlockJob *job,
                                                       int64_t start,
                                                       int64_t end,
                                                       bool is_write_notifier,
                                                       bool *error_is_read,
-                                                      void **bounce_buffer)
+                                                      void **bounce_buffer,
+                                                      int64_t buf_size)
 {
     int ret;
     BlockBackend *blk = job->common.blk;
     int nbytes;
+    int64_t copy_size;
     int read_flags = is_write_notifier ? BDRV_REQ_NO_SERIALISING : 0;
 
     assert(QEMU_IS_ALIGNED(start, job->cluster_size));
-    bdrv_reset_dirty_bitmap(job->copy_bitmap, start, job->cluster_size);
-    nbytes = MIN(job->cluster_size, job->len - start);
+    copy_size = MIN(end - start, buf_size);
+    assert(QEMU_IS_ALIGNED(copy_size, job->cluster_size));
+    bdrv_reset_dirty_bitmap(job->copy_bitmap, start, copy_size);
+    nbytes = MIN(copy_size, job->len - start);
     if (!*bounce_buffer) {
-        *bounce_buffer = blk_blockalign(blk, job->cluster_size);
+        *bounce_buffer = blk_blockalign(blk, buf_size);
     }
 
     ret = blk_co_pread(blk, start, nbytes, *bounce_buffer, read_flags);
@@ -141,7 +174,7 @@ static int coroutine_fn backup_cow_with_bounce_buffer(BackupBlockJob *job,
 
     return nbytes;
 fail:
-    bdrv_set_dirty_bitmap(job->copy_bitmap, start, job->cluster_size);
+    bdrv_set_dirty_bitmap(job->copy_bitmap, start, copy_size);
     return ret;
 
 }
@@ -257,17 +290,22 @@ static int coroutine_fn backup_do_cow(BackupBlockJob *job,
     int ret = 0;
     int64_t start, end; /* bytes */
     void *bounce_buffer = NULL;
+    int64_t buf_size;
     int64_t status_bytes;
 
     qemu_co_rwlock_rdlock(&job->flush_rwlock);
 
     start = QEMU_ALIGN_DOWN(offset, job->cluster_size);
     end = QEMU_ALIGN_UP(bytes + offset, job->cluster_size);
+    buf_size = MIN(end - start, job->max_chunk);
 
     trace_backup_do_cow_enter(job, start, offset, bytes);
 
-    wait_for_overlapping_requests(job, start, end);
-    cow_request_begin(&cow_request, job, start, end);
+    if (wait_for_overlapping_requests(job, start, end) && is_write_notifier) {
+        /* the guest waited for a background chunk; make them smaller */
+        job->chunk_size = MAX(job->chunk_size / 2, job->cluster_size);
+    }
+    cow_request_begin(&cow_request, job, start, end, is_write_notifier);
 
     while (start < end) {
         int64_t dirty_end;
@@ -307,7 +345,8 @@ static int coroutine_fn backup_do_cow(BackupBlockJob *job,
         if (!job->use_copy_range) {
             ret = backup_cow_with_bounce_buffer(job, start, dirty_end,
                                                 is_write_notifier,
-                                                error_is_read, &bounce_buffer);
+                                                error_is_read, &bounce_buffer,
+                                                buf_size);
         }
         if (ret < 0) {
             break;
@@ -341,12 +380,19 @@ static int coroutine_fn backup_before_write_notify(
 {
     BackupBlockJob *job = container_of(notifier, BackupBlockJob, before_write);
     BdrvTrackedRequest *req = opaque;
+    int ret;
 
     assert(req->bs == blk_bs(job->common.blk));
     assert(QEMU_IS_ALIGNED(req->offset, BDRV_SECTOR_SIZE));
     assert(QEMU_IS_ALIGNED(req->bytes, BDRV_SECTOR_SIZE));
 
-    return backup_do_cow(job, req->offset, req->bytes, NULL, true);
+    /* hold back new background chunks until the guest write can proceed */
+    job->cbw_requests++;
+    ret = backup_do_cow(job, req->offset, req->bytes, NULL, true);
+    job->cbw_requests--;
+    qemu_co_queue_restart_all(&job->worker_wait);
+
+    return ret;
 }
 
 static void backup_cleanup_sync_bitmap(BackupBlockJob *job, int ret)
@@ -473,34 +519,139 @@ static bool coroutine_fn yield_and_check(BackupBlockJob *job)
     return false;
 }
 
-static int coroutine_fn backup_loop(BackupBlockJob *job)
-{
-    bool error_is_read;
+typedef struct BackupWorker {
+    BackupBlockJob *job;
     int64_t offset;
+    int64_t bytes;
+} BackupWorker;
+
+static void coroutine_fn backup_worker_co(void *opaque)
+{
+    BackupWorker *w = opaque;
+    BackupBlockJob *job = w->job;
+    bool error_is_read = false;
+    int ret;
+
+    ret = backup_do_cow(job, w->offset, w->bytes, &error_is_read, false);
+    trace_backup_worker_done(job, w->offset, w->bytes, ret);
+    if (ret < 0) {
+        if (job->worker_ret == 0) {
+            job->worker_ret = ret;
+            job->worker_error_is_read = error_is_read;
+        }
+        job->chunk_size = job->cluster_size;
+    } else if (w->bytes == job->chunk_size) {
+        job->chunk_size = MIN(job->chunk_size * 2, job->max_chunk);
+    }
+
+    job->workers--;
+    qemu_co_queue_restart_all(&job->worker_wait);
+    g_free(w);
+}
+
+/*
+ * Background chunks wait for a free worker.  While guest writes wait for
+ * copy-before-write, only one chunk is copied at a time so that they get
+ * most of the bandwidth.
+ */
+static void coroutine_fn backup_wait_for_worker(BackupBlockJob *job)
+{
+    while (job->workers >= (job->cbw_requests ? 1 : job->max_workers)) {
+        qemu_co_queue_wait(&job->worker_wait, NULL);
+    }
+}
+
+static void coroutine_fn backup_wait_for_all_workers(BackupBlockJob *job)
+{
+    while (job->workers > 0) {
+        qemu_co_queue_wait(&job->worker_wait, NULL);
+    }
+}
+
+/*
+ * Copy the dirty clusters of copy_bitmap in chunks of up to chunk_size
+ * bytes, each in a coroutine of its own.  Return 1 if the job was
+ * cancelled, 0 if all chunks were copied, or the first error.
+ */
+static int coroutine_fn backup_loop_pass(BackupBlockJob *job,
+                                         bool *error_is_read)
+{
     BdrvDirtyBitmapIter *bdbi;
+    int64_t offset, end;
     int ret = 0;
 
+    job->worker_ret = 0;
     bdbi = bdrv_dirty_iter_new(job->copy_bitmap);
     while ((offset = bdrv_dirty_iter_next(bdbi)) != -1) {
-        do {
+        BackupWorker *w;
+
+        /*
+         * yield_and_check() is where the job sleeps and pauses, and drain
+         * does not wait for a job that is not busy.  Workers must therefore
+         * be done before the job gets there, or they would keep issuing
+         * I/O while it is paused.  Unless the job is rate limited or has
+         * to stop, skip it while workers are running; the job still yields
+         * in backup_wait_for_worker().
+         */
+        if (job->workers == 0 || job->common.speed ||
+            job->common.job.pause_count > 0 ||
+            job_is_cancelled(&job->common.job)) {
+            backup_wait_for_all_workers(job);
             if (yield_and_check(job)) {
-                goto out;
-            }
-            ret = backup_do_cow(job, offset,
-                                job->cluster_size, &error_is_read, false);
-            if (ret < 0 && backup_error_action(job, error_is_read, -ret) ==
-                           BLOCK_ERROR_ACTION_REPORT)
-            {
-                goto out;
+                ret = 1;
+                break;
             }
-        } while (ret < 0);
-    }
+        }
+        backup_wait_for_worker(job);
+        if (job->worker_ret < 0) {
+            break;
+        }
 
- out:
+        end = bdrv_dirty_bitmap_next_zero(job->copy_bitmap, offset,
+                                          job->chunk_size);
+        if (end < 0) {
+            end = MIN(offset + job->chunk_size,
+                      QEMU_ALIGN_UP(job->len, job->cluster_size));
+        }
+
+        w = g_new(BackupWorker, 1);
+        *w = (BackupWorker) {
+            .job = job,
+            .offset = offset,
+            .bytes = end - offset,
+        };
+        job->workers++;
+        trace_backup_worker_start(job, offset, end - offset, job->workers);
+        qemu_coroutine_enter(qemu_coroutine_create(backup_worker_co, w));
+
+        bdrv_set_dirty_iter(bdbi, end);
+    }
     bdrv_dirty_iter_free(bdbi);
+
+    backup_wait_for_all_workers(job);
+    if (job->worker_ret < 0) {
+        *error_is_read = job->worker_error_is_read;
+        return job->worker_ret;
+    }
     return ret;
 }
 
+static int coroutine_fn backup_loop(BackupBlockJob *job)
+{
+    bool error_is_read;
+    int ret;
+
+    do {
+        ret = backup_loop_pass(job, &error_is_read);
+        if (ret < 0 && backup_error_action(job, error_is_read, -ret) ==
+                       BLOCK_ERROR_ACTION_REPORT) {
+            return ret;
+        }
+    } while (ret < 0);
+
+    return 0;
+}
+
 static void backup_init_copy_bitmap(BackupBlockJob *job)
 {
     bool ret;
@@ -534,6 +685,7 @@ static int coroutine_fn backup_run(Job *job, Error **errp)
 
     QLIST_INIT(&s->inflight_reqs);
     qemu_co_rwlock_init(&s->flush_rwlock);
+    qemu_co_queue_init(&s->worker_wait);
 
     backup_init_copy_bitmap(s);
 
@@ -637,7 +789,7 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
                   BlockDriverState *target, int64_t speed,
                   MirrorSyncMode sync_mode, BdrvDirtyBitmap *sync_bitmap,
                   BitmapSyncMode bitmap_mode,
-                  bool compress,
+                  bool compress, int64_t max_workers, int64_t max_chunk,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   int creation_flags,
@@ -674,6 +826,17 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
         return NULL;
     }
 
+    if (max_workers < 0 || max_workers > BACKUP_MAX_WORKERS_LIMIT) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "max-workers",
+                   "a value between 0 and 256");
+        return NULL;
+    }
+    if (max_chunk < 0 || max_chunk > BACKUP_MAX_CHUNK_LIMIT) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "max-chunk",
+                   "a size of at most 64 MiB");
+        return NULL;
+    }
+
     if (compress && target->drv->bdrv_co_pwritev_compressed == NULL) {
         error_setg(errp, "Compression is not supported for this drive %s",
                    bdrv_get_device_name(target));
@@ -764,6 +927,17 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     job->copy_range_size = MAX(job->cluster_size,
                                QEMU_ALIGN_UP(job->copy_range_size,
                                              job->cluster_size));
+    job->max_workers = max_workers ?: BACKUP_MAX_WORKERS_DEFAULT;
+    if (compress) {
+        /* Compressed writes must not span more than one cluster */
+        job->max_chunk = job->cluster_size;
+    } else {
+        job->max_chunk = MAX(job->cluster_size,
+                             QEMU_ALIGN_UP(max_chunk ?:
+                                           BACKUP_MAX_CHUNK_DEFAULT,
+                                           job->cluster_size));
+    }
+    job->chunk_size = job->cluster_size;
 
     /* Required permissions are already taken with target's blk_new() */
     block_job_add_bdrv(&job->common, "target", target, 0, BLK_PERM_ALL,
@@ -506,7 +506,7 @@ int bdrv_commit(BlockDriverState *bs)
     }
 
     if (drv->bdrv_make_empty) {
-        ret = drv->bdrv_make_empty(bs);
+        ret = bdrv_make_empty(bs);
         if (ret < 0) {
             goto ro_cleanup;
         }
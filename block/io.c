@@ -386,6 +386,12 @@ void bdrv_do_drained_begin_quiesce(BlockDriverState *bs,
         aio_disable_external(bdrv_get_aio_context(bs));
     }
 
+    /*
+     * The graph and the image metadata may change in the drained section,
+     * in ways that bypass bdrv_co_write_req_finish().
+     */
+    bdrv_bsc_invalidate_all(bs);
+
     bdrv_parent_drained_begin(bs, parent, ignore_bds_parents);
     bdrv_drain_invoke(bs, true, NULL);
 }
@@ -1658,6 +1664,11 @@ bdrv_co_write_req_finish(BdrvChild *child, int64_t offset, uint64_t bytes,
     BlockDriverState *bs = child->bs;
 
     atomic_inc(&bs->write_gen);
+    if (req->type == BDRV_TRACKED_TRUNCATE) {
+        bdrv_bsc_invalidate_all(bs);
+    } else {
+        bdrv_bsc_invalidate_range(bs, offset, bytes);
+    }
 
     /*
      * Discard cannot extend the image, but in error handling cases, such as
@@ -2063,6 +2074,135 @@ int coroutine_fn bdrv_co_block_status_from_backing(BlockDriverState *bs,
     return BDRV_BLOCK_RAW | BDRV_BLOCK_OFFSET_VALID;
 }
 
+/*
+ * Look up the block status of @offset in the cache of @bs.  On a hit,
+ * return the status that the driver reported for the range that starts at
+ * @offset, for at most @bytes bytes, and fill in *@pnum, *@map and *@file.
+ * Return -ENOENT otherwise.
+ */
+static int bdrv_bsc_lookup(BlockDriverState *bs, bool want_zero,
+                           int64_t offset, int64_t bytes, int64_t *pnum,
+                           int64_t *map, BlockDriverState **file)
+{
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    int ret = -ENOENT;
+    int i;
+
+    qemu_mutex_lock(&bsc->lock);
+    for (i = 0; i < BDRV_BLOCK_STATUS_CACHE_SIZE; i++) {
+        BdrvBlockStatusExtent *e = &bsc->extents[i];
+
+        if (offset >= e->offset && offset < e->offset + e->bytes &&
+            (e->want_zero || !want_zero)) {
+            switch (e->file) {
+            case BDRV_BSC_FILE_NONE:
+                *file = NULL;
+                break;
+            case BDRV_BSC_FILE_SELF:
+                *file = bs;
+                break;
+            case BDRV_BSC_FILE_FILE:
+                *file = bs->file ? bs->file->bs : NULL;
+                break;
+            case BDRV_BSC_FILE_BACKING:
+                *file = bs->backing ? bs->backing->bs : NULL;
+                break;
+            default:
+                abort();
+            }
+            if (e->file != BDRV_BSC_FILE_NONE && !*file) {
+                /* the child is gone, so is the result */
+                break;
+            }
+            ret = e->ret;
+            *pnum = MIN(e->offset + e->bytes - offset, bytes);
+            *map = e->map + (offset - e->offset);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&bsc->lock);
+    return ret;
+}
+
+/*
+ * Remember the status that the driver of @bs reported for @pnum bytes at
+ * @offset, unless the cache was invalidated since @gen was read.
+ *
+ * Only data is remembered.  Writes from outside QEMU (other clients of an
+ * NBD server, shared storage, files opened without locking) do not
+ * invalidate the cache, and a stale hole or zero would make callers skip
+ * real data.  Reading back a range that is no longer data is never wrong.
+ *
+ * Results that map to a node other than @bs, its file or its backing file
+ * are not remembered.
+ */
+static void bdrv_bsc_store(BlockDriverState *bs, uint64_t gen, bool want_zero,
+                           int64_t offset, int64_t pnum, int ret,
+                           int64_t map, BlockDriverState *file)
+{
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    BdrvBlockStatusExtent *e;
+    int file_child;
+
+    if (!file) {
+        file_child = BDRV_BSC_FILE_NONE;
+    } else if (file == bs) {
+        file_child = BDRV_BSC_FILE_SELF;
+    } else if (bs->file && file == bs->file->bs) {
+        file_child = BDRV_BSC_FILE_FILE;
+    } else if (bs->backing && file == bs->backing->bs) {
+        file_child = BDRV_BSC_FILE_BACKING;
+    } else {
+        return;
+    }
+
+    if (!(ret & BDRV_BLOCK_DATA) || (ret & BDRV_BLOCK_ZERO)) {
+        return;
+    }
+
+    qemu_mutex_lock(&bsc->lock);
+    if (bsc->gen == gen) {
+        e = &bsc->extents[bsc->next];
+        bsc->next = (bsc->next + 1) % BDRV_BLOCK_STATUS_CACHE_SIZE;
+        *e = (BdrvBlockStatusExtent) {
+            .offset = offset,
+            .bytes = pnum,
+            .map = map,
+            .file = file_child,
+            /* EOF is recomputed by the caller for the range it asked for */
+            .ret = ret & ~BDRV_BLOCK_EOF,
+            .want_zero = want_zero,
+        };
+    }
+    qemu_mutex_unlock(&bsc->lock);
+}
+
+/*
+ * Forget the cached block status of @bytes bytes at @offset in @bs.
+ */
+void bdrv_bsc_invalidate_range(BlockDriverState *bs, int64_t offset,
+                               int64_t bytes)
+{
+    BdrvBlockStatusCache *bsc = &bs->block_status_cache;
+    int i;
+
+    qemu_mutex_lock(&bsc->lock);
+    bsc->gen++;
+    for (i = 0; i < BDRV_BLOCK_STATUS_CACHE_SIZE; i++) {
+        BdrvBlockStatusExtent *e = &bsc->extents[i];
+
+        if (offset < e->offset + e->bytes && e->offset < offset + bytes) {
+            e->bytes = 0;
+        }
+    }
+    qemu_mutex_unlock(&bsc->lock);
+}
+
+void bdrv_bsc_invalidate_all(BlockDriverState *bs)
+{
+    bdrv_bsc_invalidate_range(bs, 0, INT64_MAX);
+}
+
 /*
  * Returns the allocation status of the specified sectors.
  * Drivers not implementing the functionality are assumed to not support
@@ -2103,6 +2243,7 @@ static int coroutine_fn bdrv_co_block_status(BlockDriverState *bs,
     BlockDriverState *local_file = NULL;
     int64_t aligned_offset, aligned_bytes;
     uint32_t align;
+    uint64_t bsc_gen;
 
     assert(pnum);
     *pnum = 0;
@@ -2149,9 +2290,18 @@ static int coroutine_fn bdrv_co_block_status(BlockDriverState *bs,
     aligned_offset = QEMU_ALIGN_DOWN(offset, align);
     aligned_bytes = ROUND_UP(offset + bytes, align) - aligned_offset;
 
-    ret = bs->drv->bdrv_co_block_status(bs, want_zero, aligned_offset,
-                                        aligned_bytes, pnum, &local_map,
-                                        &local_file);
+    ret = bdrv_bsc_lookup(bs, want_zero, aligned_offset, aligned_bytes, pnum,
+                          &local_map, &local_file);
+    if (ret == -ENOENT) {
+        bsc_gen = atomic_read(&bs->block_status_cache.gen);
+        ret = bs->drv->bdrv_co_block_status(bs, want_zero, aligned_offset,
+                                            aligned_bytes, pnum, &local_map,
+                                            &local_file);
+        if (ret >= 0) {
+            bdrv_bsc_store(bs, bsc_gen, want_zero, aligned_offset, *pnum, ret,
+                           local_map, local_file);
+        }
+    }
     if (ret < 0) {
         *pnum = 0;
         goto out;
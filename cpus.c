@@ -234,6 +234,9 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    tb_superblocks = qemu_opt_get_bool(opts, "superblocks", false);
+    tcg_direct_ram = qemu_opt_get_bool(opts, "direct-ram", false);
 }
 
 /* The current number of executed instructions is based on what we
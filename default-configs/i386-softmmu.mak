@@ -25,4 +25,5 @@
 CONFIG_ISAPC=y
 CONFIG_I440FX=y
 CONFIG_Q35=y
+CONFIG_MICROVM=y
 CONFIG_ACPI_PCI=y
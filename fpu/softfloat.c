@@ -232,12 +232,17 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
+/*
+ * In fast FP mode (see set_float_fast_fp) the inexact flag is not
+ * tracked, so the host FPU can be used before the guest has raised it.
+ */
 static inline bool can_use_fpu(const float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
         return false;
     }
-    return likely(s->float_exception_flags & float_flag_inexact &&
+    return likely((s->float_exception_flags & float_flag_inexact ||
+                   s->fast_fp) &&
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
@@ -339,6 +344,19 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+/* 2-input is-zero-normal-or-infinity, i.e. neither denormal nor NaN */
+static inline bool f32_is_zoni2(union_float32 a, union_float32 b)
+{
+    return (float32_is_zero_or_normal(a.s) || float32_is_infinity(a.s)) &&
+           (float32_is_zero_or_normal(b.s) || float32_is_infinity(b.s));
+}
+
+static inline bool f64_is_zoni2(union_float64 a, union_float64 b)
+{
+    return (float64_is_zero_or_normal(a.s) || float64_is_infinity(a.s)) &&
+           (float64_is_zero_or_normal(b.s) || float64_is_infinity(b.s));
+}
+
 /* Note: @fast_test and @post can be NULL */
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
@@ -1920,13 +1938,30 @@ float16 float32_to_float16(float32 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float64 float32_to_float64(float32 a, float_status *s)
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float32_to_float64(float32 a, float_status *s)
 {
     FloatParts p = float32_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float64_params, s);
     return float64_round_pack_canonical(pr, s);
 }
 
+float64 float32_to_float64(float32 a, float_status *s)
+{
+    if (likely(float32_is_normal(a))) {
+        /* Widening a normal number is exact and raises no flags.  */
+        union_float32 uf;
+        union_float64 ud;
+
+        uf.s = a;
+        ud.h = uf.h;
+        return ud.s;
+    } else if (float32_is_zero(a)) {
+        return float64_set_sign(float64_zero, float32_is_neg(a));
+    }
+    return soft_float32_to_float64(a, s);
+}
+
 float16 float64_to_float16(float64 a, bool ieee, float_status *s)
 {
     const FloatFmt *fmt16 = ieee ? &float16_params : &float16_params_ahp;
@@ -1935,13 +1970,40 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts p = float64_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float32_params, s);
     return float32_round_pack_canonical(pr, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+    ur.h = ua.h;
+    if (unlikely(f32_is_inf(ur))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !float64_is_zero(ua.s)) {
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 /*
  * Rounds the floating-point value `a' to an integer, and returns the
  * result as a floating-point value. The operation is performed
@@ -2057,17 +2119,46 @@ float16 float16_round_to_int(float16 a, float_status *s)
     return float16_round_pack_canonical(pr, s);
 }
 
+/*
+ * With round-to-nearest-even and the inexact flag already set, rint()
+ * gives the same result and flags as the soft version for everything
+ * but NaNs.  The result can never be denormal.
+ */
 float32 float32_round_to_int(float32 a, float_status *s)
 {
-    FloatParts pa = float32_unpack_canonical(a, s);
-    FloatParts pr = round_to_int(pa, s->float_rounding_mode, 0, s);
+    union_float32 ua;
+    FloatParts pa, pr;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float32_input_flush1(&ua.s, s);
+        if (likely(!float32_is_any_nan(ua.s))) {
+            ua.h = rintf(ua.h);
+            return ua.s;
+        }
+    }
+
+    pa = float32_unpack_canonical(ua.s, s);
+    pr = round_to_int(pa, s->float_rounding_mode, 0, s);
     return float32_round_pack_canonical(pr, s);
 }
 
 float64 float64_round_to_int(float64 a, float_status *s)
 {
-    FloatParts pa = float64_unpack_canonical(a, s);
-    FloatParts pr = round_to_int(pa, s->float_rounding_mode, 0, s);
+    union_float64 ua;
+    FloatParts pa, pr;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float64_input_flush1(&ua.s, s);
+        if (likely(!float64_is_any_nan(ua.s))) {
+            ua.h = rint(ua.h);
+            return ua.s;
+        }
+    }
+
+    pa = float64_unpack_canonical(ua.s, s);
+    pr = round_to_int(pa, s->float_rounding_mode, 0, s);
     return float64_round_pack_canonical(pr, s);
 }
 
@@ -2211,14 +2302,46 @@ int16_t float32_to_int16(float32 a, float_status *s)
     return float32_to_int16_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
+/*
+ * The hardfloat conversions to integer below only handle results that
+ * fit the integer type; everything else, including NaNs, raises the
+ * invalid flag and is left to the soft versions.  Rounding follows
+ * can_use_fpu(), so rint() matches the guest's rounding mode and any
+ * inexact result has its flag set already.
+ */
 int32_t float32_to_int32(float32 a, float_status *s)
 {
-    return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float r;
+
+        float32_input_flush1(&ua.s, s);
+        r = rintf(ua.h);
+        if (likely(r >= -2147483648.0f && r < 2147483648.0f)) {
+            return r;
+        }
+    }
+    return float32_to_int32_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
-    return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float r;
+
+        float32_input_flush1(&ua.s, s);
+        r = rintf(ua.h);
+        if (likely(r >= -9223372036854775808.0f &&
+                   r < 9223372036854775808.0f)) {
+            return r;
+        }
+    }
+    return float32_to_int64_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int16_t float64_to_int16(float64 a, float_status *s)
@@ -2228,12 +2351,37 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
-    return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        double r;
+
+        float64_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(r >= -2147483648.0 && r <= 2147483647.0)) {
+            return r;
+        }
+    }
+    return float64_to_int32_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
-    return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        double r;
+
+        float64_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(r >= -9223372036854775808.0 &&
+                   r < 9223372036854775808.0)) {
+            return r;
+        }
+    }
+    return float64_to_int64_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int16_t float16_to_int16_round_to_zero(float16 a, float_status *s)
@@ -2256,14 +2404,34 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
     return float32_to_int16_scalbn(a, float_round_to_zero, 0, s);
 }
 
+/* C conversions truncate, so only the range check differs here.  */
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
-    return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float32_input_flush1(&ua.s, s);
+        if (likely(ua.h >= -2147483648.0f && ua.h < 2147483648.0f)) {
+            return ua.h;
+        }
+    }
+    return float32_to_int32_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
-    return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float32_input_flush1(&ua.s, s);
+        if (likely(ua.h >= -9223372036854775808.0f &&
+                   ua.h < 9223372036854775808.0f)) {
+            return ua.h;
+        }
+    }
+    return float32_to_int64_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
@@ -2273,12 +2441,31 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
-    return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float64_input_flush1(&ua.s, s);
+        if (likely(ua.h > -2147483649.0 && ua.h < 2147483648.0)) {
+            return ua.h;
+        }
+    }
+    return float64_to_int32_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
-    return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float64_input_flush1(&ua.s, s);
+        if (likely(ua.h >= -9223372036854775808.0 &&
+                   ua.h < 9223372036854775808.0)) {
+            return ua.h;
+        }
+    }
+    return float64_to_int64_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 /*
@@ -2573,13 +2760,29 @@ float32 int16_to_float32_scalbn(int16_t a, int scale, float_status *status)
     return int64_to_float32_scalbn(a, scale, status);
 }
 
+/*
+ * Integer to float conversions cannot overflow or produce denormals, and
+ * the host rounds them to nearest-even like can_use_fpu() requires.
+ */
 float32 int64_to_float32(int64_t a, float_status *status)
 {
+    if (likely(can_use_fpu(status))) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
+    if (likely(can_use_fpu(status))) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2606,12 +2809,22 @@ float64 int16_to_float64_scalbn(int16_t a, int scale, float_status *status)
 
 float64 int64_to_float64(int64_t a, float_status *status)
 {
+    if (likely(can_use_fpu(status))) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
-    return int64_to_float64_scalbn(a, 0, status);
+    union_float64 ur;
+
+    /* Exact, whatever the rounding mode and flags.  */
+    ur.h = a;
+    return ur.s;
 }
 
 float64 int16_to_float64(int16_t a, float_status *status)
@@ -2849,6 +3062,51 @@ MINMAX(16, max, false, false, false)
 MINMAX(16, maxnum, false, true, false)
 MINMAX(16, maxnummag, false, true, true)
 
+#undef MINMAX
+
+/*
+ * Without NaNs and denormals the result is one of the inputs and no
+ * flags are raised, so the host comparisons are enough.  Equal inputs
+ * can only differ in the sign of zero: min picks -0 and max +0, i.e.
+ * the bitwise OR resp. AND of the two values.
+ */
+#define MINMAX(sz, name, ismin, isiee, ismag)                           \
+float ## sz float ## sz ## _ ## name(float ## sz a, float ## sz b,      \
+                                     float_status *s)                   \
+{                                                                       \
+    union_float ## sz ua, ub;                                           \
+    FloatParts pa, pb, pr;                                              \
+                                                                        \
+    ua.s = a;                                                           \
+    ub.s = b;                                                           \
+    if (QEMU_NO_HARDFLOAT) {                                            \
+        goto soft;                                                      \
+    }                                                                   \
+                                                                        \
+    float ## sz ## _input_flush2(&ua.s, &ub.s, s);                      \
+    if (unlikely(!f ## sz ## _is_zoni2(ua, ub))) {                      \
+        goto soft;                                                      \
+    }                                                                   \
+    if (ismag && fabs(ua.h) != fabs(ub.h)) {                            \
+        return (fabs(ua.h) < fabs(ub.h)) ^ ismin ? ub.s : ua.s;         \
+    }                                                                   \
+    if (ua.h != ub.h) {                                                 \
+        return (ua.h < ub.h) ^ ismin ? ub.s : ua.s;                     \
+    }                                                                   \
+    if (ismin) {                                                        \
+        return make_float ## sz(float ## sz ## _val(ua.s) |             \
+                                float ## sz ## _val(ub.s));             \
+    }                                                                   \
+    return make_float ## sz(float ## sz ## _val(ua.s) &                 \
+                            float ## sz ## _val(ub.s));                 \
+                                                                        \
+ soft:                                                                  \
+    pa = float ## sz ## _unpack_canonical(ua.s, s);                     \
+    pb = float ## sz ## _unpack_canonical(ub.s, s);                     \
+    pr = minmax_floats(pa, pb, ismin, isiee, ismag, s);                 \
+    return float ## sz ## _round_pack_canonical(pr, s);                 \
+}
+
 MINMAX(32, min, true, false, false)
 MINMAX(32, minnum, true, true, false)
 MINMAX(32, minnummag, true, true, true)
@@ -24,6 +24,7 @@
 #include "virtio-blk.h"
 #include "block/aio.h"
 #include "hw/virtio/virtio-bus.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "qom/object_interfaces.h"
 
 struct VirtIOBlockDataPlane {
@@ -43,6 +44,20 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /*
+     * With iothread-vq-mapping, each virtqueue is processed in the
+     * AioContext of its IOThread.  The BlockBackend stays in @ctx, the
+     * context of the first IOThread, and every access to the virtqueues
+     * is done with @ctx acquired, including request submission from the
+     * other IOThreads.
+     */
+    IOThread **iothreads;
+    uint32_t num_iothreads;
+    AioContext **vq_aio_context;
+
+    /* the BlockBackend is drained; leave new requests in the virtqueues */
+    bool quiesced;
 };
 
 /* Raise an interrupt to signal guest, if necessary */
@@ -91,7 +106,7 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 
     *dataplane = NULL;
 
-    if (conf->iothread) {
+    if (conf->iothread || conf->num_iothread_vq_mapping) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -119,13 +134,34 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s = g_new0(VirtIOBlockDataPlane, 1);
     s->vdev = vdev;
     s->conf = conf;
-
-    if (conf->iothread) {
-        s->iothread = conf->iothread;
-        object_ref(OBJECT(s->iothread));
-        s->ctx = iothread_get_aio_context(s->iothread);
+    s->vq_aio_context = g_new(AioContext *, conf->num_queues);
+
+    if (conf->num_iothread_vq_mapping) {
+        s->iothreads = g_new0(IOThread *, conf->num_iothread_vq_mapping);
+        if (!iothread_vq_mapping_apply(conf->iothread_vq_mapping,
+                                       conf->num_iothread_vq_mapping,
+                                       conf->num_queues, s->iothreads,
+                                       s->vq_aio_context, errp)) {
+            g_free(s->iothreads);
+            g_free(s->vq_aio_context);
+            g_free(s);
+            return false;
+        }
+        s->num_iothreads = conf->num_iothread_vq_mapping;
+        s->ctx = s->vq_aio_context[0];
     } else {
-        s->ctx = qemu_get_aio_context();
+        unsigned i;
+
+        if (conf->iothread) {
+            s->iothread = conf->iothread;
+            object_ref(OBJECT(s->iothread));
+            s->ctx = iothread_get_aio_context(s->iothread);
+        } else {
+            s->ctx = qemu_get_aio_context();
+        }
+        for (i = 0; i < conf->num_queues; i++) {
+            s->vq_aio_context[i] = s->ctx;
+        }
     }
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
@@ -151,6 +187,9 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
     if (s->iothread) {
         object_unref(OBJECT(s->iothread));
     }
+    iothread_vq_mapping_cleanup(s->iothreads, s->num_iothreads);
+    g_free(s->iothreads);
+    g_free(s->vq_aio_context);
     g_free(s);
 }
 
@@ -165,6 +204,43 @@ static bool virtio_blk_data_plane_handle_output(VirtIODevice *vdev,
     return virtio_blk_handle_vq(s, vq);
 }
 
+/*
+ * Virtqueue handlers in the AioContext of the BlockBackend are disabled
+ * by bdrv_drained_begin() like any other external event handler; those in
+ * the other IOThreads keep running, so they check this instead.
+ *
+ * Context: AioContext of the BlockBackend acquired
+ */
+bool virtio_blk_data_plane_quiesced(VirtIOBlockDataPlane *s)
+{
+    return s->quiesced;
+}
+
+/* Context: AioContext of the BlockBackend acquired */
+void virtio_blk_data_plane_drained_begin(VirtIOBlockDataPlane *s)
+{
+    s->quiesced = true;
+}
+
+/* Context: AioContext of the BlockBackend acquired */
+void virtio_blk_data_plane_drained_end(VirtIOBlockDataPlane *s)
+{
+    VirtIOBlock *vblk = VIRTIO_BLK(s->vdev);
+    unsigned i;
+
+    s->quiesced = false;
+    if (!vblk->dataplane_started || vblk->dataplane_disabled) {
+        return;
+    }
+
+    /* Process the requests that were left in the virtqueues */
+    for (i = 0; i < s->conf->num_queues; i++) {
+        VirtQueue *vq = virtio_get_queue(s->vdev, i);
+
+        event_notifier_set(virtio_queue_get_host_notifier(vq));
+    }
+}
+
 /* Context: QEMU global mutex held */
 int virtio_blk_data_plane_start(VirtIODevice *vdev)
 {
@@ -228,14 +304,15 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     }
 
     /* Get this show started by hooking up our callbacks */
-    aio_context_acquire(s->ctx);
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
+        AioContext *ctx = s->vq_aio_context[i];
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx,
+        aio_context_acquire(ctx);
+        virtio_queue_aio_set_host_notifier_handler(vq, ctx,
                 virtio_blk_data_plane_handle_output);
+        aio_context_release(ctx);
     }
-    aio_context_release(s->ctx);
     return 0;
 
   fail_guest_notifiers:
@@ -245,19 +322,23 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     return -ENOSYS;
 }
 
-/* Stop notifications for new requests from guest.
+/* Stop notifications for new requests from guest on the virtqueues
+ * handled by the current AioContext.
  *
  * Context: BH in IOThread
  */
 static void virtio_blk_data_plane_stop_bh(void *opaque)
 {
     VirtIOBlockDataPlane *s = opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
     unsigned i;
 
     for (i = 0; i < s->conf->num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, NULL);
+        if (s->vq_aio_context[i] == ctx) {
+            virtio_queue_aio_set_host_notifier_handler(vq, ctx, NULL);
+        }
     }
 }
 
@@ -284,6 +365,18 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     s->stopping = true;
     trace_virtio_blk_data_plane_stop(s);
 
+    /*
+     * The handlers in the other IOThreads acquire s->ctx, so stop them
+     * before taking it.
+     */
+    for (i = 1; i < s->num_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->iothreads[i]);
+
+        aio_context_acquire(ctx);
+        aio_wait_bh_oneshot(ctx, virtio_blk_data_plane_stop_bh, s);
+        aio_context_release(ctx);
+    }
+
     aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_blk_data_plane_stop_bh, s);
 
@@ -0,0 +1,743 @@
+/*
+ * Minimal x86 machine with virtio-mmio devices and direct PVH kernel boot
+ *
+ * The microvm machine type is meant for short-lived guests that must
+ * start quickly.  It has no PCI bus, no ACPI tables, no firmware and no
+ * fw_cfg: the kernel is loaded as an ELF image and entered directly at
+ * its 32-bit PVH entry point, and all I/O goes through virtio-mmio
+ * transports.  The legacy PC devices (i8259, i8254, MC146818 and the ISA
+ * serial port) are optional and can be disabled with machine properties.
+ *
+ * The guest discovers CPUs and the IOAPIC through an MP table, and
+ * virtio-mmio transports through the kernel command line.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/kvm.h"
+#include "sysemu/reset.h"
+#include "exec/address-spaces.h"
+#include "hw/loader.h"
+#include "hw/irq.h"
+#include "hw/sysbus.h"
+#include "hw/i386/microvm.h"
+#include "hw/char/serial.h"
+#include "hw/timer/i8254.h"
+#include "hw/timer/mc146818rtc.h"
+#include "hw/kvm/clock.h"
+#include "hw/xen/start_info.h"
+#include "elf.h"
+#include "kvm_i386.h"
+#include "cpu.h"
+
+/* Intel MultiProcessor Specification 1.4 structures */
+
+typedef struct QEMU_PACKED {
+    char signature[4];
+    uint32_t physptr;
+    uint8_t length;
+    uint8_t specrev;
+    uint8_t checksum;
+    uint8_t feature[5];
+} MPFloatingPointer;
+
+typedef struct QEMU_PACKED {
+    char signature[4];
+    uint16_t length;
+    uint8_t spec;
+    uint8_t checksum;
+    char oemid[8];
+    char productid[12];
+    uint32_t oemptr;
+    uint16_t oemsize;
+    uint16_t oemcount;
+    uint32_t lapic;
+    uint16_t exttable_length;
+    uint8_t exttable_checksum;
+    uint8_t reserved;
+} MPConfigTable;
+
+typedef struct QEMU_PACKED {
+    uint8_t type;
+    uint8_t apicid;
+    uint8_t apicver;
+    uint8_t cpuflag;
+    uint32_t cpufeature;
+    uint32_t featureflag;
+    uint32_t reserved[2];
+} MPProcessorEntry;
+
+typedef struct QEMU_PACKED {
+    uint8_t type;
+    uint8_t busid;
+    char bustype[6];
+} MPBusEntry;
+
+typedef struct QEMU_PACKED {
+    uint8_t type;
+    uint8_t apicid;
+    uint8_t apicver;
+    uint8_t flags;
+    uint32_t apicaddr;
+} MPIOAPICEntry;
+
+typedef struct QEMU_PACKED {
+    uint8_t type;
+    uint8_t irqtype;
+    uint16_t irqflag;
+    uint8_t srcbus;
+    uint8_t srcbusirq;
+    uint8_t dstapic;
+    uint8_t dstirq;
+} MPIntSrcEntry;
+
+#define MP_PROCESSOR        0
+#define MP_BUS              1
+#define MP_IOAPIC           2
+#define MP_INTSRC           3
+#define MP_LINTSRC          4
+
+#define MP_CPU_ENABLED      0x01
+#define MP_CPU_BOOTPROCESSOR 0x02
+
+#define MP_INT              0
+#define MP_NMI              1
+#define MP_EXTINT           3
+
+/* active high, level triggered */
+#define MP_IRQFLAG_LEVEL_HIGH 0x0d
+
+#define MP_ISA_BUS_ID       0
+/* the ID that the IOAPIC itself reports in its ID register */
+#define MP_IOAPIC_ID        0
+
+static uint8_t microvm_checksum(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    uint8_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return -sum;
+}
+
+static void microvm_add_intsrc(GByteArray *table, uint8_t type,
+                               uint8_t irqtype, uint16_t irqflag,
+                               uint8_t srcbusirq, uint8_t dstapic,
+                               uint8_t dstirq)
+{
+    MPIntSrcEntry e = {
+        .type = type,
+        .irqtype = irqtype,
+        .irqflag = cpu_to_le16(irqflag),
+        .srcbus = MP_ISA_BUS_ID,
+        .srcbusirq = srcbusirq,
+        .dstapic = dstapic,
+        .dstirq = dstirq,
+    };
+
+    g_byte_array_append(table, (uint8_t *)&e, sizeof(e));
+}
+
+/*
+ * Build an MP table describing the present CPUs, the IOAPIC and the
+ * routing of the ISA and virtio-mmio interrupts.  Linux finds it by
+ * scanning the BIOS area for the floating pointer structure.
+ */
+static void microvm_mptable_setup(MicrovmMachineState *mms)
+{
+    MachineState *ms = MACHINE(mms);
+    const CPUArchIdList *possible_cpus;
+    GByteArray *table = g_byte_array_new();
+    MPFloatingPointer *mpf;
+    MPConfigTable *cfg;
+    MPBusEntry bus = {
+        .type = MP_BUS,
+        .busid = MP_ISA_BUS_ID,
+        .bustype = "ISA   ",
+    };
+    MPIOAPICEntry ioapic = {
+        .type = MP_IOAPIC,
+        .apicid = MP_IOAPIC_ID,
+        .apicver = 0x20,
+        .flags = 1,
+        .apicaddr = cpu_to_le32(IO_APIC_DEFAULT_ADDRESS),
+    };
+    uint16_t count = 0;
+    int i;
+
+    /* the headers are filled in last, once the entries are known */
+    g_byte_array_set_size(table, sizeof(*mpf) + sizeof(*cfg));
+    memset(table->data, 0, table->len);
+
+    possible_cpus = MACHINE_GET_CLASS(ms)->possible_cpu_arch_ids(ms);
+    for (i = 0; i < possible_cpus->len; i++) {
+        X86CPU *cpu;
+        MPProcessorEntry e = {
+            .type = MP_PROCESSOR,
+            .apicver = 0x14,
+        };
+
+        if (!possible_cpus->cpus[i].cpu) {
+            continue;
+        }
+        cpu = X86_CPU(possible_cpus->cpus[i].cpu);
+        e.apicid = possible_cpus->cpus[i].arch_id;
+        e.cpuflag = MP_CPU_ENABLED | (count ? 0 : MP_CPU_BOOTPROCESSOR);
+        e.cpufeature = cpu_to_le32(cpu->env.cpuid_version);
+        e.featureflag = cpu_to_le32(cpu->env.features[FEAT_1_EDX]);
+        g_byte_array_append(table, (uint8_t *)&e, sizeof(e));
+        count++;
+    }
+
+    g_byte_array_append(table, (uint8_t *)&bus, sizeof(bus));
+    g_byte_array_append(table, (uint8_t *)&ioapic, sizeof(ioapic));
+    count += 2;
+
+    /* ISA interrupts are edge triggered; IRQ0 is routed to pin 2 */
+    for (i = 0; i < ISA_NUM_IRQS; i++) {
+        if (i == 2) {
+            continue;
+        }
+        microvm_add_intsrc(table, MP_INTSRC, MP_INT, 0, i, MP_IOAPIC_ID,
+                           i ? i : 2);
+        count++;
+    }
+    for (i = 0; i < MICROVM_VIRTIO_MMIO_NUM; i++) {
+        int gsi = MICROVM_VIRTIO_MMIO_GSI + i;
+
+        microvm_add_intsrc(table, MP_INTSRC, MP_INT, MP_IRQFLAG_LEVEL_HIGH,
+                           gsi, MP_IOAPIC_ID, gsi);
+        count++;
+    }
+    microvm_add_intsrc(table, MP_LINTSRC, MP_EXTINT, 0, 0, 0xff, 0);
+    microvm_add_intsrc(table, MP_LINTSRC, MP_NMI, 0, 0, 0xff, 1);
+    count += 2;
+
+    if (table->len > MICROVM_MPTABLE_MAX_SIZE) {
+        error_report("microvm: MP table too large (%u bytes)", table->len);
+        exit(1);
+    }
+
+    cfg = (MPConfigTable *)(table->data + sizeof(*mpf));
+    memcpy(cfg->signature, "PCMP", 4);
+    cfg->length = cpu_to_le16(table->len - sizeof(*mpf));
+    cfg->spec = 4;
+    memcpy(cfg->oemid, "QEMU    ", 8);
+    memcpy(cfg->productid, "microvm     ", 12);
+    cfg->oemcount = cpu_to_le16(count);
+    cfg->lapic = cpu_to_le32(APIC_DEFAULT_ADDRESS);
+    cfg->checksum = microvm_checksum(cfg, table->len - sizeof(*mpf));
+
+    mpf = (MPFloatingPointer *)table->data;
+    memcpy(mpf->signature, "_MP_", 4);
+    mpf->physptr = cpu_to_le32(MICROVM_MPTABLE_ADDR + sizeof(*mpf));
+    mpf->length = 1;
+    mpf->specrev = 4;
+    mpf->checksum = microvm_checksum(mpf, sizeof(*mpf));
+
+    rom_add_blob_fixed("microvm-mptable", table->data, table->len,
+                       MICROVM_MPTABLE_ADDR);
+    g_byte_array_free(table, true);
+}
+
+/*
+ * The PVH entry point is a 32-bit value, stored in the descriptor of the
+ * XEN_ELFNOTE_PHYS32_ENTRY note.
+ */
+static uint32_t microvm_pvh_entry;
+
+static uint64_t microvm_read_pvh_entry(void *arg1, void *arg2, bool is64)
+{
+    uint32_t *desc;
+
+    if (arg1 == NULL) {
+        return 0;
+    }
+
+    if (is64) {
+        struct elf64_note *nhdr64 = arg1;
+        uint64_t phdr_align = *(uint64_t *)arg2;
+
+        desc = arg1 + sizeof(*nhdr64) +
+               QEMU_ALIGN_UP(nhdr64->n_namesz, phdr_align);
+    } else {
+        struct elf32_note *nhdr32 = arg1;
+        uint32_t phdr_align = *(uint32_t *)arg2;
+
+        desc = arg1 + sizeof(*nhdr32) +
+               QEMU_ALIGN_UP(nhdr32->n_namesz, phdr_align);
+    }
+
+    microvm_pvh_entry = ldl_le_p(desc);
+    return microvm_pvh_entry;
+}
+
+static bool microvm_transport_in_use(DeviceState *dev)
+{
+    BusState *bus;
+
+    QLIST_FOREACH(bus, &dev->child_bus, sibling) {
+        if (!QTAILQ_EMPTY(&bus->children)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static char *microvm_build_cmdline(MicrovmMachineState *mms)
+{
+    MachineState *ms = MACHINE(mms);
+    GString *cmdline = g_string_new(ms->kernel_cmdline);
+    int i;
+
+    if (!mms->auto_kernel_cmdline) {
+        return g_string_free(cmdline, false);
+    }
+
+    for (i = 0; i < MICROVM_VIRTIO_MMIO_NUM; i++) {
+        hwaddr base = MICROVM_VIRTIO_MMIO_BASE + i * MICROVM_VIRTIO_MMIO_SIZE;
+
+        if (microvm_transport_in_use(mms->virtio_mmio[i])) {
+            g_string_append_printf(cmdline,
+                                   " virtio_mmio.device=%d@0x%" HWADDR_PRIx
+                                   ":%d", MICROVM_VIRTIO_MMIO_SIZE, base,
+                                   MICROVM_VIRTIO_MMIO_GSI + i);
+        }
+    }
+    return g_string_free(cmdline, false);
+}
+
+static void microvm_add_memmap(GArray *memmap, uint64_t addr, uint64_t size,
+                               uint32_t type)
+{
+    struct hvm_memmap_table_entry e = {
+        .addr = cpu_to_le64(addr),
+        .size = cpu_to_le64(size),
+        .type = cpu_to_le32(type),
+    };
+
+    g_array_append_val(memmap, e);
+}
+
+/*
+ * Load the kernel and the initrd, then lay out the command line and the
+ * hvm_start_info structure that %ebx points to on entry.
+ */
+static void microvm_load_kernel(MicrovmMachineState *mms)
+{
+    MachineState *ms = MACHINE(mms);
+    PCMachineState *pcms = PC_MACHINE(mms);
+    uint64_t elf_note_type = XEN_ELFNOTE_PHYS32_ENTRY;
+    uint64_t elf_entry, elf_low, elf_high;
+    struct hvm_start_info *start_info;
+    struct hvm_modlist_entry *mod;
+    GArray *memmap;
+    size_t start_info_size;
+    uint8_t *blob;
+    char *cmdline;
+    size_t cmdline_size;
+    int kernel_size;
+
+    microvm_pvh_entry = 0;
+    kernel_size = load_elf(ms->kernel_filename, microvm_read_pvh_entry,
+                           NULL, &elf_note_type, &elf_entry,
+                           &elf_low, &elf_high, 0, I386_ELF_MACHINE, 0, 0);
+    if (kernel_size < 0) {
+        error_report("microvm: could not load kernel '%s'",
+                     ms->kernel_filename);
+        exit(1);
+    }
+    if (microvm_pvh_entry == 0) {
+        error_report("microvm: kernel '%s' has no PVH ELF note",
+                     ms->kernel_filename);
+        exit(1);
+    }
+    mms->pvh_entry = microvm_pvh_entry;
+
+    cmdline = microvm_build_cmdline(mms);
+    cmdline_size = strlen(cmdline) + 1;
+    if (cmdline_size > MICROVM_CMDLINE_MAX_SIZE) {
+        error_report("microvm: kernel command line too long (%zu bytes)",
+                     cmdline_size);
+        exit(1);
+    }
+    rom_add_blob_fixed("microvm-cmdline", cmdline, cmdline_size,
+                       MICROVM_CMDLINE_ADDR);
+    g_free(cmdline);
+
+    start_info_size = sizeof(*start_info) + sizeof(*mod);
+    blob = g_malloc0(start_info_size);
+    start_info = (struct hvm_start_info *)blob;
+    mod = (struct hvm_modlist_entry *)(blob + sizeof(*start_info));
+
+    if (ms->initrd_filename) {
+        int initrd_size = get_image_size(ms->initrd_filename);
+        hwaddr initrd_addr;
+
+        if (initrd_size < 0) {
+            error_report("microvm: could not load initrd '%s'",
+                         ms->initrd_filename);
+            exit(1);
+        }
+        initrd_addr = (pcms->below_4g_mem_size - initrd_size) &
+                      TARGET_PAGE_MASK;
+        if (initrd_size > pcms->below_4g_mem_size ||
+            initrd_addr < elf_high) {
+            error_report("microvm: no room for initrd '%s' below 4G",
+                         ms->initrd_filename);
+            exit(1);
+        }
+        load_image_targphys(ms->initrd_filename, initrd_addr, initrd_size);
+
+        mod->paddr = cpu_to_le64(initrd_addr);
+        mod->size = cpu_to_le64(initrd_size);
+        start_info->nr_modules = cpu_to_le32(1);
+        start_info->modlist_paddr =
+            cpu_to_le64(MICROVM_START_INFO_ADDR + sizeof(*start_info));
+    }
+
+    memmap = g_array_new(false, false, sizeof(struct hvm_memmap_table_entry));
+    microvm_add_memmap(memmap, 0, 0xa0000, E820_RAM);
+    microvm_add_memmap(memmap, 0xf0000, 0x10000, E820_RESERVED);
+    microvm_add_memmap(memmap, 1 * MiB, pcms->below_4g_mem_size - 1 * MiB,
+                       E820_RAM);
+    if (pcms->above_4g_mem_size) {
+        microvm_add_memmap(memmap, 4 * GiB, pcms->above_4g_mem_size,
+                           E820_RAM);
+    }
+
+    start_info->magic = cpu_to_le32(XEN_HVM_START_MAGIC_VALUE);
+    start_info->version = cpu_to_le32(1);
+    start_info->cmdline_paddr = cpu_to_le64(MICROVM_CMDLINE_ADDR);
+    start_info->memmap_paddr = cpu_to_le64(MICROVM_START_INFO_ADDR +
+                                           start_info_size);
+    start_info->memmap_entries = cpu_to_le32(memmap->len);
+
+    blob = g_realloc(blob, start_info_size +
+                     memmap->len * sizeof(struct hvm_memmap_table_entry));
+    memcpy(blob + start_info_size, memmap->data,
+           memmap->len * sizeof(struct hvm_memmap_table_entry));
+    start_info_size += memmap->len * sizeof(struct hvm_memmap_table_entry);
+    g_array_free(memmap, true);
+
+    assert(start_info_size <= MICROVM_START_INFO_MAX_SIZE);
+    rom_add_blob_fixed("microvm-start-info", blob, start_info_size,
+                       MICROVM_START_INFO_ADDR);
+    g_free(blob);
+}
+
+/*
+ * The boot data depends on the CPUs and virtio devices added with
+ * -device, so it can only be built once the machine is complete.
+ */
+static void microvm_machine_done(Notifier *notifier, void *data)
+{
+    MicrovmMachineState *mms = container_of(notifier, MicrovmMachineState,
+                                            machine_done);
+
+    microvm_mptable_setup(mms);
+    microvm_load_kernel(mms);
+}
+
+static void microvm_memory_init(MicrovmMachineState *mms)
+{
+    MachineState *ms = MACHINE(mms);
+    PCMachineState *pcms = PC_MACHINE(mms);
+    MemoryRegion *system_memory = get_system_memory();
+    MemoryRegion *ram, *ram_below_4g, *ram_above_4g;
+    ram_addr_t lowmem = pcms->max_ram_below_4g;
+
+    /* keep clear of the IOAPIC, LAPIC and virtio-mmio windows */
+    if (!lowmem || lowmem > 3 * GiB) {
+        lowmem = 3 * GiB;
+    }
+    if (ms->ram_size > lowmem) {
+        pcms->below_4g_mem_size = lowmem;
+        pcms->above_4g_mem_size = ms->ram_size - lowmem;
+    } else {
+        pcms->below_4g_mem_size = ms->ram_size;
+        pcms->above_4g_mem_size = 0;
+    }
+    if (pcms->below_4g_mem_size < 2 * MiB) {
+        error_report("microvm: at least 2 MiB of RAM are required");
+        exit(1);
+    }
+
+    ram = g_malloc(sizeof(*ram));
+    memory_region_allocate_system_memory(ram, NULL, "microvm.ram",
+                                         ms->ram_size);
+
+    ram_below_4g = g_malloc(sizeof(*ram_below_4g));
+    memory_region_init_alias(ram_below_4g, NULL, "ram-below-4g", ram,
+                             0, pcms->below_4g_mem_size);
+    memory_region_add_subregion(system_memory, 0, ram_below_4g);
+
+    if (pcms->above_4g_mem_size > 0) {
+        ram_above_4g = g_malloc(sizeof(*ram_above_4g));
+        memory_region_init_alias(ram_above_4g, NULL, "ram-above-4g", ram,
+                                 pcms->below_4g_mem_size,
+                                 pcms->above_4g_mem_size);
+        memory_region_add_subregion(system_memory, 4 * GiB, ram_above_4g);
+    }
+}
+
+static void microvm_devices_init(MicrovmMachineState *mms)
+{
+    PCMachineState *pcms = PC_MACHINE(mms);
+    ISABus *isa_bus;
+    GSIState *gsi_state;
+    int i;
+
+    gsi_state = g_malloc0(sizeof(*gsi_state));
+    if (kvm_ioapic_in_kernel()) {
+        kvm_pc_setup_irq_routing(true);
+        pcms->gsi = qemu_allocate_irqs(kvm_pc_gsi_handler, gsi_state,
+                                       GSI_NUM_PINS);
+    } else {
+        pcms->gsi = qemu_allocate_irqs(gsi_handler, gsi_state, GSI_NUM_PINS);
+    }
+    ioapic_init_gsi(gsi_state, "/machine");
+
+    isa_bus = isa_bus_new(NULL, get_system_memory(), get_system_io(),
+                          &error_abort);
+    isa_bus_irqs(isa_bus, pcms->gsi);
+
+    if (mms->pic) {
+        qemu_irq *i8259;
+
+        if (kvm_pic_in_kernel()) {
+            i8259 = kvm_i8259_init(isa_bus);
+        } else {
+            i8259 = i8259_init(isa_bus, pc_allocate_cpu_irq());
+        }
+        for (i = 0; i < ISA_NUM_IRQS; i++) {
+            gsi_state->i8259_irq[i] = i8259[i];
+        }
+        g_free(i8259);
+    }
+
+    if (pcms->pit_enabled) {
+        if (kvm_pit_in_kernel()) {
+            kvm_pit_init(isa_bus, 0x40);
+        } else {
+            i8254_pit_init(isa_bus, 0x40, 0, NULL);
+        }
+    }
+
+    if (mms->rtc) {
+        pcms->rtc = mc146818_rtc_init(isa_bus, 2000, NULL);
+    }
+
+    if (mms->isa_serial) {
+        serial_hds_isa_init(isa_bus, 0, 1);
+    }
+
+    for (i = 0; i < MICROVM_VIRTIO_MMIO_NUM; i++) {
+        mms->virtio_mmio[i] = sysbus_create_simple("virtio-mmio",
+            MICROVM_VIRTIO_MMIO_BASE + i * MICROVM_VIRTIO_MMIO_SIZE,
+            pcms->gsi[MICROVM_VIRTIO_MMIO_GSI + i]);
+    }
+}
+
+static void microvm_machine_init(MachineState *ms)
+{
+    MicrovmMachineState *mms = MICROVM_MACHINE(ms);
+
+    if (!ms->kernel_filename) {
+        error_report("microvm: a PVH kernel must be given with -kernel");
+        exit(1);
+    }
+
+    microvm_memory_init(mms);
+    pc_cpus_init(PC_MACHINE(mms));
+
+    if (kvm_enabled()) {
+        kvmclock_create();
+    }
+
+    microvm_devices_init(mms);
+
+    mms->machine_done.notify = microvm_machine_done;
+    qemu_add_machine_init_done_notifier(&mms->machine_done);
+}
+
+/*
+ * Put the boot CPU in the state required by the PVH boot ABI: 32-bit
+ * protected mode with flat segments, paging disabled, and %ebx pointing
+ * to the hvm_start_info structure.
+ */
+static void microvm_cpu_reset(MicrovmMachineState *mms, X86CPU *cpu)
+{
+    CPUX86State *env = &cpu->env;
+    unsigned int flags = DESC_P_MASK | DESC_S_MASK | DESC_A_MASK |
+                         DESC_B_MASK | DESC_G_MASK;
+
+    cpu_x86_update_cr0(env, CR0_PE_MASK | CR0_ET_MASK);
+    cpu_x86_load_seg_cache(env, R_CS, 0x10, 0, 0xffffffff,
+                           flags | DESC_CS_MASK | DESC_R_MASK);
+    cpu_x86_load_seg_cache(env, R_DS, 0x18, 0, 0xffffffff,
+                           flags | DESC_W_MASK);
+    cpu_x86_load_seg_cache(env, R_ES, 0x18, 0, 0xffffffff,
+                           flags | DESC_W_MASK);
+    cpu_x86_load_seg_cache(env, R_SS, 0x18, 0, 0xffffffff,
+                           flags | DESC_W_MASK);
+    cpu_x86_load_seg_cache(env, R_FS, 0x18, 0, 0xffffffff,
+                           flags | DESC_W_MASK);
+    cpu_x86_load_seg_cache(env, R_GS, 0x18, 0, 0xffffffff,
+                           flags | DESC_W_MASK);
+
+    env->regs[R_EBX] = MICROVM_START_INFO_ADDR;
+    env->eip = mms->pvh_entry;
+    env->eflags = 0x2;
+}
+
+static void microvm_machine_reset(MachineState *ms)
+{
+    MicrovmMachineState *mms = MICROVM_MACHINE(ms);
+    CPUState *cs;
+    X86CPU *cpu;
+
+    qemu_devices_reset();
+
+    CPU_FOREACH(cs) {
+        cpu = X86_CPU(cs);
+
+        if (cpu->apic_state) {
+            device_reset(cpu->apic_state);
+        }
+        if (cs == first_cpu) {
+            microvm_cpu_reset(mms, cpu);
+        }
+    }
+}
+
+static bool microvm_machine_get_pic(Object *obj, Error **errp)
+{
+    return MICROVM_MACHINE(obj)->pic;
+}
+
+static void microvm_machine_set_pic(Object *obj, bool value, Error **errp)
+{
+    MICROVM_MACHINE(obj)->pic = value;
+}
+
+static bool microvm_machine_get_rtc(Object *obj, Error **errp)
+{
+    return MICROVM_MACHINE(obj)->rtc;
+}
+
+static void microvm_machine_set_rtc(Object *obj, bool value, Error **errp)
+{
+    MICROVM_MACHINE(obj)->rtc = value;
+}
+
+static bool microvm_machine_get_isa_serial(Object *obj, Error **errp)
+{
+    return MICROVM_MACHINE(obj)->isa_serial;
+}
+
+static void microvm_machine_set_isa_serial(Object *obj, bool value,
+                                           Error **errp)
+{
+    MICROVM_MACHINE(obj)->isa_serial = value;
+}
+
+static bool microvm_machine_get_auto_kernel_cmdline(Object *obj, Error **errp)
+{
+    return MICROVM_MACHINE(obj)->auto_kernel_cmdline;
+}
+
+static void microvm_machine_set_auto_kernel_cmdline(Object *obj, bool value,
+                                                    Error **errp)
+{
+    MICROVM_MACHINE(obj)->auto_kernel_cmdline = value;
+}
+
+static void microvm_machine_initfn(Object *obj)
+{
+    MicrovmMachineState *mms = MICROVM_MACHINE(obj);
+    PCMachineState *pcms = PC_MACHINE(obj);
+
+    mms->pic = true;
+    mms->rtc = true;
+    mms->isa_serial = true;
+    mms->auto_kernel_cmdline = true;
+
+    /* there is no firmware to enter SMM or talk to vmport */
+    pcms->smm = ON_OFF_AUTO_OFF;
+    pcms->vmport = ON_OFF_AUTO_OFF;
+}
+
+static void microvm_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+    PCMachineClass *pcmc = PC_MACHINE_CLASS(oc);
+
+    mc->desc = "Minimal x86 machine with virtio-mmio devices";
+    mc->init = microvm_machine_init;
+    mc->reset = microvm_machine_reset;
+    mc->wakeup = NULL;
+    mc->max_cpus = 255;
+    mc->has_hotpluggable_cpus = false;
+    mc->hot_add_cpu = NULL;
+    mc->auto_enable_numa_with_memhp = false;
+    mc->no_floppy = 1;
+    mc->no_cdrom = 1;
+    mc->no_parallel = 1;
+    mc->no_sdcard = 1;
+
+    pcmc->pci_enabled = false;
+    pcmc->has_acpi_build = false;
+    pcmc->smbios_defaults = false;
+    pcmc->has_reserved_memory = false;
+    pcmc->kvmclock_enabled = true;
+    pcmc->linuxboot_dma_enabled = false;
+    pcmc->pvh_enabled = true;
+
+    object_class_property_add_bool(oc, MICROVM_MACHINE_PIC,
+        microvm_machine_get_pic, microvm_machine_set_pic, &error_abort);
+    object_class_property_set_description(oc, MICROVM_MACHINE_PIC,
+        "Create the i8259 interrupt controllers", &error_abort);
+
+    object_class_property_add_bool(oc, MICROVM_MACHINE_RTC,
+        microvm_machine_get_rtc, microvm_machine_set_rtc, &error_abort);
+    object_class_property_set_description(oc, MICROVM_MACHINE_RTC,
+        "Create the MC146818 real time clock", &error_abort);
+
+    object_class_property_add_bool(oc, MICROVM_MACHINE_ISA_SERIAL,
+        microvm_machine_get_isa_serial, microvm_machine_set_isa_serial,
+        &error_abort);
+    object_class_property_set_description(oc, MICROVM_MACHINE_ISA_SERIAL,
+        "Create the ISA serial port", &error_abort);
+
+    object_class_property_add_bool(oc, MICROVM_MACHINE_AUTO_KERNEL_CMDLINE,
+        microvm_machine_get_auto_kernel_cmdline,
+        microvm_machine_set_auto_kernel_cmdline, &error_abort);
+    object_class_property_set_description(oc,
+        MICROVM_MACHINE_AUTO_KERNEL_CMDLINE,
+        "Describe the virtio-mmio transports on the kernel command line",
+        &error_abort);
+}
+
+static const TypeInfo microvm_machine_info = {
+    .name          = TYPE_MICROVM_MACHINE,
+    .parent        = TYPE_PC_MACHINE,
+    .instance_size = sizeof(MicrovmMachineState),
+    .instance_init = microvm_machine_initfn,
+    .class_init    = microvm_machine_class_init,
+};
+
+static void microvm_machine_init_types(void)
+{
+    type_register_static(&microvm_machine_info);
+}
+type_init(microvm_machine_init_types)
@@ -1529,6 +1529,25 @@ void scsi_device_purge_requests(SCSIDevice *sdev, SCSISense sense)
     scsi_device_set_ua(sdev, sense);
 }
 
+void scsi_device_drained_begin(SCSIDevice *sdev)
+{
+    SCSIBus *bus = scsi_bus_from_device(sdev);
+
+    if (bus->drain_count++ == 0 && bus->info->drained_begin) {
+        bus->info->drained_begin(bus);
+    }
+}
+
+void scsi_device_drained_end(SCSIDevice *sdev)
+{
+    SCSIBus *bus = scsi_bus_from_device(sdev);
+
+    assert(bus->drain_count > 0);
+    if (--bus->drain_count == 0 && bus->info->drained_end) {
+        bus->info->drained_end(bus);
+    }
+}
+
 static char *scsibus_get_dev_path(DeviceState *dev)
 {
     SCSIDevice *d = SCSI_DEVICE(dev);
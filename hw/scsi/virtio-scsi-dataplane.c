@@ -20,6 +20,7 @@
 #include "scsi/constants.h"
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 
 /* Context: QEMU global mutex held */
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
@@ -28,8 +29,15 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    uint32_t i;
 
-    if (vs->conf.iothread) {
+    if (vs->conf.iothread && vs->conf.num_iothread_vq_mapping) {
+        error_setg(errp, "iothread and iothread-vq-mapping properties "
+                   "cannot be set at the same time");
+        return;
+    }
+
+    if (vs->conf.iothread || vs->conf.num_iothread_vq_mapping) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -40,13 +48,47 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
             error_setg(errp, "ioeventfd is required for iothread");
             return;
         }
-        s->ctx = iothread_get_aio_context(vs->conf.iothread);
-    } else {
-        if (!virtio_device_ioeventfd_enabled(vdev)) {
+    } else if (!virtio_device_ioeventfd_enabled(vdev)) {
+        return;
+    }
+
+    s->cmd_vq_aio_context = g_new(AioContext *, vs->conf.num_queues);
+    if (vs->conf.num_iothread_vq_mapping) {
+        s->iothreads = g_new0(IOThread *, vs->conf.num_iothread_vq_mapping);
+        if (!iothread_vq_mapping_apply(vs->conf.iothread_vq_mapping,
+                                       vs->conf.num_iothread_vq_mapping,
+                                       vs->conf.num_queues, s->iothreads,
+                                       s->cmd_vq_aio_context, errp)) {
+            g_free(s->iothreads);
+            s->iothreads = NULL;
+            g_free(s->cmd_vq_aio_context);
+            s->cmd_vq_aio_context = NULL;
             return;
         }
+        s->num_iothreads = vs->conf.num_iothread_vq_mapping;
+        s->ctx = s->cmd_vq_aio_context[0];
+        return;
+    }
+
+    if (vs->conf.iothread) {
+        s->ctx = iothread_get_aio_context(vs->conf.iothread);
+    } else {
         s->ctx = qemu_get_aio_context();
     }
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        s->cmd_vq_aio_context[i] = s->ctx;
+    }
+}
+
+/* Context: QEMU global mutex held */
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s)
+{
+    iothread_vq_mapping_cleanup(s->iothreads, s->num_iothreads);
+    g_free(s->iothreads);
+    s->iothreads = NULL;
+    s->num_iothreads = 0;
+    g_free(s->cmd_vq_aio_context);
+    s->cmd_vq_aio_context = NULL;
 }
 
 static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
@@ -56,12 +98,37 @@ static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
     VirtIOSCSI *s = VIRTIO_SCSI(vdev);
 
     virtio_scsi_acquire(s);
-    assert(s->ctx && s->dataplane_started);
+    assert(s->ctx);
+    /*
+     * Handlers in the other IOThreads are not disabled by drained
+     * sections, and can still run while a failed start is undone;
+     * leave the requests in the virtqueue in both cases.
+     */
+    if (!s->dataplane_started || s->bus.drain_count) {
+        virtio_scsi_release(s);
+        return false;
+    }
     progress = virtio_scsi_handle_cmd_vq(s, vq);
     virtio_scsi_release(s);
     return progress;
 }
 
+/* Context: s->ctx acquired */
+void virtio_scsi_dataplane_drained_end(VirtIOSCSI *s)
+{
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    int i;
+
+    if (!s->dataplane_started || s->dataplane_fenced) {
+        return;
+    }
+
+    /* Process the requests that were left in the virtqueues */
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        event_notifier_set(virtio_queue_get_host_notifier(vs->cmd_vqs[i]));
+    }
+}
+
 static bool virtio_scsi_data_plane_handle_ctrl(VirtIODevice *vdev,
                                                VirtQueue *vq)
 {
@@ -89,7 +156,7 @@ static bool virtio_scsi_data_plane_handle_event(VirtIODevice *vdev,
 }
 
 static int virtio_scsi_vring_init(VirtIOSCSI *s, VirtQueue *vq, int n,
-                                  VirtIOHandleAIOOutput fn)
+                                  AioContext *ctx, VirtIOHandleAIOOutput fn)
 {
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(s)));
     int rc;
@@ -103,21 +170,51 @@ static int virtio_scsi_vring_init(VirtIOSCSI *s, VirtQueue *vq, int n,
         return rc;
     }
 
-    virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, fn);
+    aio_context_acquire(ctx);
+    virtio_queue_aio_set_host_notifier_handler(vq, ctx, fn);
+    aio_context_release(ctx);
     return 0;
 }
 
-/* Context: BH in IOThread */
+/* Stop the virtqueue handlers that run in the current AioContext.
+ *
+ * Context: BH in IOThread
+ */
 static void virtio_scsi_dataplane_stop_bh(void *opaque)
 {
     VirtIOSCSI *s = opaque;
     VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    AioContext *ctx = qemu_get_current_aio_context();
     int i;
 
-    virtio_queue_aio_set_host_notifier_handler(vs->ctrl_vq, s->ctx, NULL);
-    virtio_queue_aio_set_host_notifier_handler(vs->event_vq, s->ctx, NULL);
+    if (ctx == s->ctx) {
+        virtio_queue_aio_set_host_notifier_handler(vs->ctrl_vq, ctx, NULL);
+        virtio_queue_aio_set_host_notifier_handler(vs->event_vq, ctx, NULL);
+    }
     for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], s->ctx, NULL);
+        if (s->cmd_vq_aio_context[i] == ctx) {
+            virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], ctx,
+                                                       NULL);
+        }
+    }
+}
+
+/*
+ * The handlers in the other IOThreads acquire s->ctx, so they must be
+ * stopped without holding it.
+ *
+ * Context: QEMU global mutex held
+ */
+static void virtio_scsi_dataplane_stop_others(VirtIOSCSI *s)
+{
+    uint32_t i;
+
+    for (i = 1; i < s->num_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->iothreads[i]);
+
+        aio_context_acquire(ctx);
+        aio_wait_bh_oneshot(ctx, virtio_scsi_dataplane_stop_bh, s);
+        aio_context_release(ctx);
     }
 }
 
@@ -148,18 +245,19 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
     }
 
     aio_context_acquire(s->ctx);
-    rc = virtio_scsi_vring_init(s, vs->ctrl_vq, 0,
+    rc = virtio_scsi_vring_init(s, vs->ctrl_vq, 0, s->ctx,
                                 virtio_scsi_data_plane_handle_ctrl);
     if (rc) {
         goto fail_vrings;
     }
-    rc = virtio_scsi_vring_init(s, vs->event_vq, 1,
+    rc = virtio_scsi_vring_init(s, vs->event_vq, 1, s->ctx,
                                 virtio_scsi_data_plane_handle_event);
     if (rc) {
         goto fail_vrings;
     }
     for (i = 0; i < vs->conf.num_queues; i++) {
         rc = virtio_scsi_vring_init(s, vs->cmd_vqs[i], i + 2,
+                                    s->cmd_vq_aio_context[i],
                                     virtio_scsi_data_plane_handle_cmd);
         if (rc) {
             goto fail_vrings;
@@ -172,6 +270,9 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
     return 0;
 
 fail_vrings:
+    aio_context_release(s->ctx);
+    virtio_scsi_dataplane_stop_others(s);
+    aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
     aio_context_release(s->ctx);
     for (i = 0; i < vs->conf.num_queues + 2; i++) {
@@ -207,6 +308,7 @@ void virtio_scsi_dataplane_stop(VirtIODevice *vdev)
     }
     s->dataplane_stopping = true;
 
+    virtio_scsi_dataplane_stop_others(s);
     aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
     aio_context_release(s->ctx);
@@ -0,0 +1,61 @@
+/*
+ * Assignment of virtqueues to IOThreads
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/virtio/iothread-vq-mapping.h"
+
+bool iothread_vq_mapping_apply(char **ids, uint32_t num_ids,
+                               uint16_t num_queues, IOThread **iothreads,
+                               AioContext **vq_aio_context, Error **errp)
+{
+    uint32_t i, j;
+    uint16_t vq;
+
+    if (num_ids > num_queues) {
+        error_setg(errp, "iothread-vq-mapping lists %" PRIu32 " IOThreads "
+                   "but there are only %" PRIu16 " virtqueues",
+                   num_ids, num_queues);
+        return false;
+    }
+
+    for (i = 0; i < num_ids; i++) {
+        if (!ids[i]) {
+            error_setg(errp, "iothread-vq-mapping[%" PRIu32 "] is not set", i);
+            return false;
+        }
+        for (j = 0; j < i; j++) {
+            if (strcmp(ids[i], ids[j]) == 0) {
+                error_setg(errp, "IOThread '%s' is listed more than once in "
+                           "iothread-vq-mapping", ids[i]);
+                return false;
+            }
+        }
+        iothreads[i] = iothread_by_id(ids[i]);
+        if (!iothreads[i]) {
+            error_setg(errp, "IOThread '%s' not found", ids[i]);
+            return false;
+        }
+    }
+
+    for (i = 0; i < num_ids; i++) {
+        object_ref(OBJECT(iothreads[i]));
+    }
+    for (vq = 0; vq < num_queues; vq++) {
+        vq_aio_context[vq] = iothread_get_aio_context(iothreads[vq % num_ids]);
+    }
+    return true;
+}
+
+void iothread_vq_mapping_cleanup(IOThread **iothreads, uint32_t num_ids)
+{
+    uint32_t i;
+
+    for (i = 0; i < num_ids; i++) {
+        object_unref(OBJECT(iothreads[i]));
+    }
+}
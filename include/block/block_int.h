@@ -57,6 +57,8 @@
 #define BLOCK_OPT_REFCOUNT_BITS     "refcount_bits"
 #define BLOCK_OPT_DATA_FILE         "data_file"
 #define BLOCK_OPT_DATA_FILE_RAW     "data_file_raw"
+#define BLOCK_OPT_EXTL2             "extended_l2"
+#define BLOCK_OPT_COMPRESSION_TYPE  "compression_type"
 
 #define BLOCK_PROBE_BUF_SIZE        512
 
@@ -624,6 +626,47 @@ typedef struct BlockLimits {
 
 typedef struct BdrvOpBlocker BdrvOpBlocker;
 
+/*
+ * Block status of a range of a node, as returned by its driver's
+ * bdrv_co_block_status.  @bytes is 0 for an unused entry.
+ */
+typedef struct BdrvBlockStatusExtent {
+    int64_t offset;
+    int64_t bytes;
+    int64_t map;
+    /*
+     * The node that @map refers to.  It is stored as the child it was
+     * reached through, and looked up again on every hit, so that the
+     * cache holds no pointer to a node that may go away.
+     */
+    enum {
+        BDRV_BSC_FILE_NONE,     /* the driver left *file NULL */
+        BDRV_BSC_FILE_SELF,     /* the node itself */
+        BDRV_BSC_FILE_FILE,     /* bs->file */
+        BDRV_BSC_FILE_BACKING,  /* bs->backing */
+    } file;
+    int ret;
+    bool want_zero;
+} BdrvBlockStatusExtent;
+
+#define BDRV_BLOCK_STATUS_CACHE_SIZE 16
+
+/*
+ * Recent results of the driver's bdrv_co_block_status, so that scans of
+ * the same ranges (by mirror, stream, qemu-img convert or the NBD server,
+ * often once for every node of a backing chain) need not ask the driver
+ * again.  Only data ranges are cached, since writes from outside QEMU
+ * cannot invalidate them.  Entries are dropped when the range is written
+ * to.
+ */
+typedef struct BdrvBlockStatusCache {
+    QemuMutex lock;
+    /* bumped on every invalidation; results computed across one are dropped */
+    uint64_t gen;
+    unsigned int next;          /* entry to replace next */
+    BdrvBlockStatusExtent extents[BDRV_BLOCK_STATUS_CACHE_SIZE];
+} BdrvBlockStatusCache;
+
 typedef struct BdrvAioNotifier {
     void (*attached_aio_context)(AioContext *new_context, void *opaque);
     void (*detach_aio_context)(void *opaque);
@@ -896,6 +939,8 @@ struct BlockDriverState {
 
     unsigned int write_gen;               /* Current data generation */
 
+    BdrvBlockStatusCache block_status_cache;
+
     /* Protected by reqs_lock.  */
     CoMutex reqs_lock;
     QLIST_HEAD(, BdrvTrackedRequest) tracked_requests;
@@ -1158,6 +1203,11 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
  * @sync_mode: What parts of the disk image should be copied to the destination.
  * @sync_bitmap: The dirty bitmap if sync_mode is 'bitmap' or 'incremental'
  * @bitmap_mode: The bitmap synchronization policy to use.
+ * @compress: Whether to compress the data written to @target.
+ * @max_workers: The number of chunks to copy in parallel, or 0 for the
+ *               default.
+ * @max_chunk: The largest chunk to copy at once, in bytes, or 0 for the
+ *             default.
  * @on_source_error: The action to take upon error reading from the source.
  * @on_target_error: The action to take upon error writing to the target.
  * @creation_flags: Flags that control the behavior of the Job lifetime.
@@ -1174,7 +1224,8 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
                             MirrorSyncMode sync_mode,
                             BdrvDirtyBitmap *sync_bitmap,
                             BitmapSyncMode bitmap_mode,
-                            bool compress,
+                            bool compress, int64_t max_workers,
+                            int64_t max_chunk,
                             BlockdevOnError on_source_error,
                             BlockdevOnError on_target_error,
                             int creation_flags,
@@ -1269,6 +1320,10 @@ bool bdrv_dirty_bitmap_merge_internal(BdrvDirtyBitmap *dest,
 void bdrv_inc_in_flight(BlockDriverState *bs);
 void bdrv_dec_in_flight(BlockDriverState *bs);
 
+void bdrv_bsc_invalidate_range(BlockDriverState *bs, int64_t offset,
+                               int64_t bytes);
+void bdrv_bsc_invalidate_all(BlockDriverState *bs);
+
 void blockdev_close_all_bdrv_states(void);
 
 int coroutine_fn bdrv_co_copy_range_from(BdrvChild *src, uint64_t src_offset,
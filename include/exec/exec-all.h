@@ -313,6 +313,25 @@ static inline void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu,
 }
 #endif
 
+/**
+ * probe_access:
+ * @env: CPUArchState
+ * @addr: guest virtual address of the access
+ * @size: size of the access, which must not cross a page boundary
+ * @access_type: type of the access
+ * @mmu_idx: MMU index to use for lookup
+ * @retaddr: host return address for unwinding on a fault
+ *
+ * Check that the access is permitted, raising the guest exception a real
+ * access would if it is not.  Then return the host address of @addr, so
+ * that a run of accesses within the page can be done with host memcpy or
+ * memset.  Return NULL if the page cannot be accessed directly (MMIO,
+ * watchpoints, dirty or translated code tracking): the caller must then
+ * use cpu_ld* and cpu_st*, which also raise the exception in user-mode.
+ */
+void *probe_access(CPUArchState *env, target_ulong addr, int size,
+                   MMUAccessType access_type, int mmu_idx, uintptr_t retaddr);
+
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
 
 /* Estimated block size for TB allocation.  */
@@ -351,6 +370,9 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_EXEC_COUNT  0x00100000 /* Count executions in @exec_count */
+#define CF_SUPERBLOCK  0x00200000 /* Built by tb_gen_superblock() */
+#define CF_HOST_PTR    0x00400000 /* Code embeds pointers to host data */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
@@ -360,6 +382,12 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /*
+     * Number of times the TB was entered, if cflags has CF_EXEC_COUNT.
+     * Updated without synchronization by the generated code.
+     */
+    uint32_t exec_count;
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
@@ -430,6 +458,7 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr, MemTxAttrs attrs);
 #endif
 void tb_flush(CPUState *cpu);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
+void tb_gen_superblock(CPUState *cpu, TranslationBlock *head);
 TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
                                    target_ulong cs_base, uint32_t flags,
                                    uint32_t cf_mask);
@@ -513,4 +542,13 @@ hwaddr memory_region_section_get_iotlb(CPUState *cpu,
 /* vl.c */
 extern int singlestep;
 
+/* translate-all.c */
+extern bool tb_superblocks;
+
+/*
+ * A TB with CF_EXEC_COUNT exits with TB_EXIT_REQUESTED once it has run
+ * this many times, so that it can be rebuilt as a superblock.
+ */
+#define TB_SUPERBLOCK_THRESHOLD 1024
+
 #endif
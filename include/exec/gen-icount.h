@@ -32,10 +32,24 @@ static inline void gen_io_end(void)
     tcg_temp_free_i32(tmp);
 }
 
+/*
+ * The blocks that follow the first one in a superblock are only entered
+ * from the superblock itself, so they need neither an exit check nor an
+ * exitreq label.
+ */
+static inline bool gen_tb_in_superblock_tail(void)
+{
+    return tcg_ctx->superblock && tcg_ctx->superblock->index > 0;
+}
+
 static inline void gen_tb_start(TranslationBlock *tb)
 {
     TCGv_i32 count, imm;
 
+    if (gen_tb_in_superblock_tail()) {
+        return;
+    }
+
     tcg_ctx->exitreq_label = gen_new_label();
     if (tb_cflags(tb) & CF_USE_ICOUNT) {
         count = tcg_temp_local_new_i32();
@@ -69,10 +83,27 @@ static inline void gen_tb_start(TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    if (tb_cflags(tb) & CF_EXEC_COUNT) {
+        TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+
+        count = tcg_temp_new_i32();
+        tcg_gen_ld_i32(count, ptr, 0);
+        tcg_gen_addi_i32(count, count, 1);
+        tcg_gen_st_i32(count, ptr, 0);
+        tcg_gen_brcondi_i32(TCG_COND_EQ, count, TB_SUPERBLOCK_THRESHOLD,
+                            tcg_ctx->exitreq_label);
+        tcg_temp_free_i32(count);
+        tcg_temp_free_ptr(ptr);
+    }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
 {
+    if (gen_tb_in_superblock_tail()) {
+        return;
+    }
+
     if (tb_cflags(tb) & CF_USE_ICOUNT) {
         /* Update the num_insn immediate parameter now that we know
          * the actual insn count.  */
@@ -422,6 +422,12 @@ struct MemoryListener {
     void (*log_stop)(MemoryListener *listener, MemoryRegionSection *section,
                      int old, int new);
     void (*log_sync)(MemoryListener *listener, MemoryRegionSection *section);
+    /*
+     * Alternative to log_sync for listeners that do not track dirty
+     * memory per section (e.g. KVM dirty rings): called once per sync
+     * for the whole address space instead of once per flat range.
+     */
+    void (*log_sync_global)(MemoryListener *listener);
     void (*log_clear)(MemoryListener *listener, MemoryRegionSection *section);
     void (*log_global_start)(MemoryListener *listener);
     void (*log_global_stop)(MemoryListener *listener);
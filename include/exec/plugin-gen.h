@@ -0,0 +1,57 @@
+/*
+ * Plugin Support - generation of instrumentation code
+ *
+ * This header should be included only from translator code and from
+ * C files that emit TCG code.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_PLUGIN_GEN_H
+#define QEMU_PLUGIN_GEN_H
+
+#include "qemu/plugin.h"
+#include "tcg/tcg.h"
+
+struct DisasContextBase;
+
+#ifdef CONFIG_PLUGIN
+
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb);
+void plugin_gen_tb_end(CPUState *cpu);
+void plugin_gen_insn_start(CPUState *cpu, const struct DisasContextBase *db);
+void plugin_gen_insn_end(CPUState *cpu, const struct DisasContextBase *db);
+
+TCGv_i64 plugin_prep_mem_callbacks(TCGv vaddr);
+void plugin_gen_mem_callbacks(TCGv_i64 vaddr, uint8_t info);
+
+#else /* !CONFIG_PLUGIN */
+
+static inline
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb)
+{
+    return false;
+}
+
+static inline void plugin_gen_tb_end(CPUState *cpu)
+{ }
+
+static inline
+void plugin_gen_insn_start(CPUState *cpu, const struct DisasContextBase *db)
+{ }
+
+static inline
+void plugin_gen_insn_end(CPUState *cpu, const struct DisasContextBase *db)
+{ }
+
+static inline TCGv_i64 plugin_prep_mem_callbacks(TCGv vaddr)
+{
+    return NULL;
+}
+
+static inline void plugin_gen_mem_callbacks(TCGv_i64 vaddr, uint8_t info)
+{ }
+
+#endif /* CONFIG_PLUGIN */
+
+#endif /* QEMU_PLUGIN_GEN_H */
@@ -0,0 +1,82 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+#include "exec/exec-all.h"
+
+/**
+ * tb_cache_init:
+ * @dir: directory that holds the cache files
+ * @exec_fd: file descriptor of the guest executable
+ * @cpu_type: QOM type of the emulated CPU
+ *
+ * Enable the persistent translation cache.  There is a cache file for
+ * each guest executable and CPU type; it holds the code that was in the
+ * code buffer when an earlier run exited.  Must be called before the
+ * guest executable is loaded, so that its mappings are tracked.
+ *
+ * The code in the cache files is run without further checks, so @dir
+ * must only be writable by the user that runs QEMU.
+ */
+void tb_cache_init(const char *dir, int exec_fd, const char *cpu_type);
+
+/**
+ * tb_cache_load:
+ *
+ * Put the cached code back in the code buffer, and make visible the
+ * TBs of the mappings that exist already.  Must be called after the
+ * prologue is generated and before any other code.
+ */
+void tb_cache_load(void);
+
+/**
+ * tb_cache_save:
+ *
+ * Save the TBs of the file mappings to the cache file, if code was
+ * generated since the cache was loaded or last saved.  Call before the
+ * process exits or execs another program.
+ */
+void tb_cache_save(void);
+
+/**
+ * tb_cache_map:
+ * @start: guest address of the mapping
+ * @len: length of the mapping
+ * @prot: protection of the mapping
+ * @fd: file descriptor of the mapped file, or -1 for anonymous mappings
+ * @offset: offset in the file of @start
+ *
+ * Track a new mapping, and make visible the cached TBs for it if it
+ * maps the same file at the same address as in an earlier run.  TBs are
+ * only used if the guest pages that they were translated from still
+ * have the same contents.
+ *
+ * Called with mmap_lock held.
+ */
+void tb_cache_map(target_ulong start, target_ulong len, int prot, int fd,
+                  uint64_t offset);
+
+/**
+ * tb_cache_unmap:
+ * @start: guest address of the unmapped range
+ * @len: length of the unmapped range
+ *
+ * Stop tracking mappings in the given range.  Called with mmap_lock held.
+ */
+void tb_cache_unmap(target_ulong start, target_ulong len);
+
+/**
+ * tb_cache_discard:
+ *
+ * Forget the cached TBs that were not made visible yet, because the
+ * code buffer is being flushed or evicted.  Called with mmap_lock held.
+ */
+void tb_cache_discard(void);
+
+#endif
@@ -35,6 +35,8 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    size_t superblock_count;
+    size_t superblock_blocks;
 };
 
 extern TBContext tb_ctx;
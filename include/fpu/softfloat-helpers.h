@@ -94,6 +94,11 @@ static inline void set_snan_bit_is_one(flag val, float_status *status)
     status->snan_bit_is_one = val;
 }
 
+static inline void set_float_fast_fp(flag val, float_status *status)
+{
+    status->fast_fp = val;
+}
+
 static inline int get_float_detect_tininess(float_status *status)
 {
     return status->float_detect_tininess;
@@ -129,4 +134,9 @@ static inline flag get_default_nan_mode(float_status *status)
     return status->default_nan_mode;
 }
 
+static inline flag get_float_fast_fp(float_status *status)
+{
+    return status->fast_fp;
+}
+
 #endif /* _SOFTFLOAT_HELPERS_H_ */
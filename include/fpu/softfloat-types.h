@@ -175,6 +175,11 @@ typedef struct float_status {
     flag default_nan_mode;
     /* not always used -- see snan_bit_is_one() in softfloat-specialize.h */
     flag snan_bit_is_one;
+    /*
+     * may the host FPU be used even if the inexact flag is clear?  The
+     * inexact flag is then not raised reliably.
+     */
+    flag fast_fp;
 } float_status;
 
 #endif /* SOFTFLOAT_TYPES_H */
@@ -0,0 +1,65 @@
+/*
+ * Minimal x86 machine with virtio-mmio devices and direct PVH kernel boot
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef HW_I386_MICROVM_H
+#define HW_I386_MICROVM_H
+
+#include "hw/i386/pc.h"
+
+/* virtio-mmio transports, wired to the IOAPIC pins above the ISA range */
+#define MICROVM_VIRTIO_MMIO_BASE    0xfeb00000
+#define MICROVM_VIRTIO_MMIO_SIZE    0x200
+#define MICROVM_VIRTIO_MMIO_NUM     8
+#define MICROVM_VIRTIO_MMIO_GSI     16
+
+/*
+ * Boot data lives in the BIOS area, which the memory map given to the
+ * guest marks as reserved.
+ */
+#define MICROVM_MPTABLE_ADDR        0xf0000
+#define MICROVM_MPTABLE_MAX_SIZE    0x4000
+#define MICROVM_START_INFO_ADDR     0xf4000
+#define MICROVM_START_INFO_MAX_SIZE 0x1000
+#define MICROVM_CMDLINE_ADDR        0xf5000
+#define MICROVM_CMDLINE_MAX_SIZE    0xb000
+
+/* Machine properties */
+#define MICROVM_MACHINE_PIC                 "pic"
+#define MICROVM_MACHINE_RTC                 "rtc"
+#define MICROVM_MACHINE_ISA_SERIAL          "isa-serial"
+#define MICROVM_MACHINE_AUTO_KERNEL_CMDLINE "auto-kernel-cmdline"
+
+/**
+ * MicrovmMachineState:
+ * @pic: whether to create the i8259 interrupt controllers
+ * @rtc: whether to create the MC146818 real time clock
+ * @isa_serial: whether to create the ISA serial port
+ * @auto_kernel_cmdline: whether to describe the virtio-mmio transports
+ *                       on the kernel command line
+ * @virtio_mmio: the virtio-mmio transports
+ * @pvh_entry: 32-bit PVH entry point of the loaded kernel
+ */
+typedef struct {
+    /*< private >*/
+    PCMachineState parent_obj;
+
+    /*< public >*/
+    bool pic;
+    bool rtc;
+    bool isa_serial;
+    bool auto_kernel_cmdline;
+
+    DeviceState *virtio_mmio[MICROVM_VIRTIO_MMIO_NUM];
+    uint32_t pvh_entry;
+    Notifier machine_done;
+} MicrovmMachineState;
+
+#define TYPE_MICROVM_MACHINE   MACHINE_TYPE_NAME("microvm")
+#define MICROVM_MACHINE(obj) \
+    OBJECT_CHECK(MicrovmMachineState, (obj), TYPE_MICROVM_MACHINE)
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Assignment of virtqueues to IOThreads
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef HW_VIRTIO_IOTHREAD_VQ_MAPPING_H
+#define HW_VIRTIO_IOTHREAD_VQ_MAPPING_H
+
+#include "sysemu/iothread.h"
+
+/**
+ * iothread_vq_mapping_apply:
+ * @ids: the IOThread ids given in the device's iothread-vq-mapping property
+ * @num_ids: the number of elements in @ids
+ * @num_queues: the number of virtqueues to assign
+ * @iothreads: array of @num_ids elements that receives the IOThreads
+ * @vq_aio_context: array of @num_queues elements that receives the
+ *                  AioContext of each virtqueue
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Assign virtqueue i to the IOThread named by @ids[i % @num_ids].  A
+ * reference is taken on each IOThread, to be dropped with
+ * iothread_vq_mapping_cleanup().
+ *
+ * Returns: true on success, false with @errp set if an IOThread does not
+ * exist, is listed twice or would not get any virtqueue.
+ */
+bool iothread_vq_mapping_apply(char **ids, uint32_t num_ids,
+                               uint16_t num_queues, IOThread **iothreads,
+                               AioContext **vq_aio_context, Error **errp);
+
+/**
+ * iothread_vq_mapping_cleanup:
+ * @iothreads: the IOThreads filled in by iothread_vq_mapping_apply()
+ * @num_ids: the number of elements in @iothreads
+ *
+ * Drop the references taken by iothread_vq_mapping_apply().
+ */
+void iothread_vq_mapping_cleanup(IOThread **iothreads, uint32_t num_ids);
+
+#endif
@@ -57,6 +57,8 @@ struct VirtIOSCSIConf {
     CharBackend chardev;
     uint32_t boot_tpgt;
     IOThread *iothread;
+    uint32_t num_iothread_vq_mapping;
+    char **iothread_vq_mapping;
 };
 
 struct VirtIOSCSI;
@@ -80,7 +82,16 @@ typedef struct VirtIOSCSI {
     bool events_dropped;
 
     /* Fields for dataplane below */
-    AioContext *ctx; /* one iothread per virtio-scsi-pci for now */
+    AioContext *ctx; /* the ctrl and event virtqueues and the SCSI devices */
+
+    /*
+     * With iothread-vq-mapping, each command virtqueue is processed in the
+     * AioContext of its IOThread, with @ctx acquired.  @ctx is the
+     * AioContext of the first IOThread.
+     */
+    IOThread **iothreads;
+    uint32_t num_iothreads;
+    AioContext **cmd_vq_aio_context;
 
     bool dataplane_started;
     bool dataplane_starting;
@@ -155,6 +166,8 @@ void virtio_scsi_push_event(VirtIOSCSI *s, SCSIDevice *dev,
                             uint32_t event, uint32_t reason);
 
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp);
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s);
+void virtio_scsi_dataplane_drained_end(VirtIOSCSI *s);
 int virtio_scsi_dataplane_start(VirtIODevice *s);
 void virtio_scsi_dataplane_stop(VirtIODevice *s);
 
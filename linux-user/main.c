@@ -36,12 +36,14 @@
 #include "qemu/module.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/tb-cache.h"
 #include "tcg.h"
 #include "qemu/timer.h"
 #include "qemu/envlist.h"
 #include "qemu/guest-random.h"
 #include "elf.h"
 #include "trace/control.h"
+#include "qemu/plugin.h"
 #include "target_elf.h"
 #include "cpu_loop-common.h"
 #include "crypto/init.h"
@@ -374,6 +376,28 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_superblocks(const char *arg)
+{
+    tb_superblocks = true;
+}
+
+static void handle_arg_tcg_threads(const char *arg)
+{
+    unsigned long n;
+
+    if (qemu_strtoul(arg, NULL, 0, &n) < 0 || n == 0 || n > 64) {
+        fprintf(stderr, "tcg-threads must be between 1 and 64\n");
+        exit(EXIT_FAILURE);
+    }
+    tcg_translators = n;
+}
+
+static const char *tb_cache_dir;
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_dir = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     do_strace = 1;
@@ -393,6 +417,13 @@ static void handle_arg_trace(const char *arg)
     trace_file = trace_opt_parse(arg);
 }
 
+static QemuPluginList plugins = QTAILQ_HEAD_INITIALIZER(plugins);
+
+static void handle_arg_plugin(const char *arg)
+{
+    qemu_plugin_opt_parse(arg, &plugins);
+}
+
 struct qemu_argument {
     const char *argv;
     const char *env;
@@ -440,10 +471,18 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"superblocks", "QEMU_SUPERBLOCKS", false, handle_arg_superblocks,
+     "",           "retranslate hot code as superblocks"},
+    {"tcg-threads", "QEMU_TCG_THREADS", true, handle_arg_tcg_threads,
+     "n",          "translate code in up to 'n' threads at once"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code in a persistent cache in 'dir'"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
      "",           "[[enable=]<pattern>][,events=<file>][,file=<file>]"},
+    {"plugin",     "QEMU_PLUGIN",      true,  handle_arg_plugin,
+     "",           "[file=]<file>[,arg=<string>]"},
     {"version",    "QEMU_VERSION",     false, handle_arg_version,
      "",           "display version information and exit"},
     {NULL, NULL, false, NULL, NULL, NULL}
@@ -634,6 +673,7 @@ int main(int argc, char **argv, char **envp)
     cpu_model = NULL;
 
     qemu_add_opts(&qemu_trace_opts);
+    qemu_plugin_add_opts();
 
     optind = parse_args(argc, argv);
 
@@ -641,6 +681,9 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
     trace_init_file(trace_file);
+    if (qemu_plugin_load_list(&plugins)) {
+        exit(1);
+    }
 
     /* Zero out regs */
     memset(regs, 0, sizeof(struct target_pt_regs));
@@ -669,6 +712,11 @@ int main(int argc, char **argv, char **envp)
     }
     cpu_type = parse_cpu_option(cpu_model);
 
+    /* the cached code would not honour single-stepping or plugins */
+    if (tb_cache_dir && !singlestep && !qemu_plugin_tb_trans_enabled()) {
+        tb_cache_init(tb_cache_dir, execfd, cpu_type);
+    }
+
     /* init tcg before creating CPUs and to get qemu_host_page_size */
     tcg_exec_init(0);
 
@@ -824,6 +872,7 @@ int main(int argc, char **argv, char **envp)
        the real value of GUEST_BASE into account.  */
     tcg_prologue_init(tcg_ctx);
     tcg_region_init();
+    tb_cache_load();
 
     target_cpu_copy_regs(env, regs);
 
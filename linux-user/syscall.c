@@ -109,6 +109,7 @@
 #include "uname.h"
 
 #include "qemu.h"
+#include "exec/tb-cache.h"
 #include "qemu/guest-random.h"
 #include "qapi/error.h"
 #include "fd-trans.h"
@@ -7495,6 +7496,8 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
 
             if (!(p = lock_user_string(arg1)))
                 goto execve_efault;
+            /* Save the translated code before the process is replaced */
+            tb_cache_save();
             /* Although execve() is not an interruptible syscall it is
              * a special case where we must use the safe_syscall wrapper:
              * if we allow a signal to happen before we make the host
@@ -19,6 +19,7 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "trace.h"
 #include "nbd-internal.h"
@@ -118,6 +119,7 @@ struct NBDClient {
     char *tlsauthz;
     QIOChannelSocket *sioc; /* The underlying data channel */
     QIOChannel *ioc; /* The current I/O channel which may differ (eg TLS) */
+    AioContext *ctx; /* Context for the channel, or NULL to follow exp->ctx */
 
     Coroutine *recv_coroutine;
 
@@ -1343,42 +1345,91 @@ static int nbd_receive_request(QIOChannel *ioc, NBDRequest *request,
 
 #define MAX_NBD_REQUESTS 16
 
+/* The context in which the client's channel and coroutines run */
+static AioContext *nbd_client_io_ctx(NBDClient *client)
+{
+    return client->ctx ?: client->exp->ctx;
+}
+
+/*
+ * Clients with a context of their own access the export's BlockBackend
+ * from its AioContext only.  nbd_export_enter() moves the calling
+ * coroutine there and nbd_export_leave() brings it back, so that the
+ * block layer never sees the client's thread.
+ */
+static void coroutine_fn nbd_export_enter(NBDClient *client)
+{
+    if (client->ctx) {
+        AioContext *ctx = atomic_read(&client->exp->ctx);
+
+        /* Only qemu-nbd uses client contexts; its export never moves */
+        assert(ctx);
+        aio_co_reschedule_self(ctx);
+    }
+}
+
+static void coroutine_fn nbd_export_leave(NBDClient *client)
+{
+    if (client->ctx) {
+        aio_co_reschedule_self(client->ctx);
+    }
+}
+
 void nbd_client_get(NBDClient *client)
 {
-    client->refcount++;
+    atomic_inc(&client->refcount);
+}
+
+static void nbd_client_free(void *opaque)
+{
+    NBDClient *client = opaque;
+
+    qio_channel_detach_aio_context(client->ioc);
+    object_unref(OBJECT(client->sioc));
+    object_unref(OBJECT(client->ioc));
+    if (client->tlscreds) {
+        object_unref(OBJECT(client->tlscreds));
+    }
+    g_free(client->tlsauthz);
+    if (client->exp) {
+        QTAILQ_REMOVE(&client->exp->clients, client, next);
+        nbd_export_put(client->exp);
+    }
+    g_free(client);
 }
 
 void nbd_client_put(NBDClient *client)
 {
-    if (--client->refcount == 0) {
+    if (atomic_fetch_dec(&client->refcount) == 1) {
         /* The last reference should be dropped by client->close,
          * which is called by client_close.
          */
-        assert(client->closing);
+        assert(atomic_read(&client->closing));
 
-        qio_channel_detach_aio_context(client->ioc);
-        object_unref(OBJECT(client->sioc));
-        object_unref(OBJECT(client->ioc));
-        if (client->tlscreds) {
-            object_unref(OBJECT(client->tlscreds));
-        }
-        g_free(client->tlsauthz);
-        if (client->exp) {
-            QTAILQ_REMOVE(&client->exp->clients, client, next);
-            nbd_export_put(client->exp);
+        /* The export and its list of clients belong to the main loop */
+        if (qemu_get_current_aio_context() != qemu_get_aio_context()) {
+            aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                                    nbd_client_free, client);
+        } else {
+            nbd_client_free(client);
         }
-        g_free(client);
     }
 }
 
+static void client_close_fn_bh(void *opaque)
+{
+    NBDClient *client = opaque;
+
+    client->close_fn(client, true);
+    nbd_client_put(client);
+}
+
 static void client_close(NBDClient *client, bool negotiated)
 {
-    if (client->closing) {
+    if (atomic_xchg(&client->closing, true)) {
         return;
     }
 
-    client->closing = true;
-
     /* Force requests to finish.  They will drop their own references,
      * then we'll close the socket and free the NBDClient.
      */
@@ -1387,7 +1438,18 @@ static void client_close(NBDClient *client, bool negotiated)
 
     /* Also tell the client, so that they release their reference.  */
     if (client->close_fn) {
-        client->close_fn(client, negotiated);
+        if (qemu_get_current_aio_context() != qemu_get_aio_context()) {
+            /*
+             * Only requests run outside the main loop, so negotiation
+             * is over; close_fn expects to be called from the main loop.
+             */
+            assert(negotiated);
+            nbd_client_get(client);
+            aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                                    client_close_fn_bh, client);
+        } else {
+            client->close_fn(client, negotiated);
+        }
     }
 }
 
@@ -1429,6 +1491,9 @@ static void blk_aio_attached(AioContext *ctx, void *opaque)
     exp->ctx = ctx;
 
     QTAILQ_FOREACH(client, &exp->clients, next) {
+        if (client->ctx) {
+            continue;
+        }
         qio_channel_attach_aio_context(client->ioc, ctx);
         if (client->recv_coroutine) {
             aio_co_schedule(ctx, client->recv_coroutine);
@@ -1447,7 +1512,9 @@ static void blk_aio_detach(void *opaque)
     trace_nbd_blk_aio_detach(exp->name, exp->ctx);
 
     QTAILQ_FOREACH(client, &exp->clients, next) {
-        qio_channel_detach_aio_context(client->ioc);
+        if (!client->ctx) {
+            qio_channel_detach_aio_context(client->ioc);
+        }
     }
 
     exp->ctx = NULL;
@@ -1814,12 +1881,15 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
 
     while (progress < size) {
         int64_t pnum;
-        int status = bdrv_block_status_above(blk_bs(exp->blk), NULL,
-                                             offset + progress,
-                                             size - progress, &pnum, NULL,
-                                             NULL);
+        int status;
         bool final;
 
+        nbd_export_enter(client);
+        status = bdrv_block_status_above(blk_bs(exp->blk), NULL,
+                                         offset + progress,
+                                         size - progress, &pnum, NULL,
+                                         NULL);
+        nbd_export_leave(client);
         if (status < 0) {
             char *msg = g_strdup_printf("unable to check for holes: %s",
                                         strerror(-status));
@@ -1846,8 +1916,10 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             stl_be_p(&chunk.length, pnum);
             ret = nbd_co_send_iov(client, iov, 1, errp);
         } else {
+            nbd_export_enter(client);
             ret = blk_pread(exp->blk, offset + progress + exp->dev_offset,
                             data + progress, pnum);
+            nbd_export_leave(client);
             if (ret < 0) {
                 error_setg_errno(errp, -ret, "reading from file failed");
                 break;
@@ -1968,8 +2040,10 @@ static int nbd_co_send_block_status(NBDClient *client, uint64_t handle,
     NBDExtent *extents = g_new(NBDExtent, nb_extents);
     uint64_t final_length = length;
 
+    nbd_export_enter(client);
     ret = blockstatus_to_extents(bs, offset, &final_length, extents,
                                  &nb_extents);
+    nbd_export_leave(client);
     if (ret < 0) {
         g_free(extents);
         return nbd_co_send_structured_error(
@@ -2202,7 +2276,9 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
 
     /* XXX: NBD Protocol only documents use of FUA with WRITE */
     if (request->flags & NBD_CMD_FLAG_FUA) {
+        nbd_export_enter(client);
         ret = blk_co_flush(exp->blk);
+        nbd_export_leave(client);
         if (ret < 0) {
             return nbd_send_generic_reply(client, request->handle, ret,
                                           "flush failed", errp);
@@ -2216,8 +2292,10 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                        data, request->len, errp);
     }
 
+    nbd_export_enter(client);
     ret = blk_pread(exp->blk, request->from + exp->dev_offset, data,
                     request->len);
+    nbd_export_leave(client);
     if (ret < 0) {
         return nbd_send_generic_reply(client, request->handle, ret,
                                       "reading from file failed", errp);
@@ -2252,8 +2330,10 @@ static coroutine_fn int nbd_do_cmd_cache(NBDClient *client, NBDRequest *request,
 
     assert(request->type == NBD_CMD_CACHE);
 
+    nbd_export_enter(client);
     ret = blk_co_preadv(exp->blk, request->from + exp->dev_offset, request->len,
                         NULL, BDRV_REQ_COPY_ON_READ | BDRV_REQ_PREFETCH);
+    nbd_export_leave(client);
 
     return nbd_send_generic_reply(client, request->handle, ret,
                                   "caching data failed", errp);
@@ -2283,8 +2363,10 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
         if (request->flags & NBD_CMD_FLAG_FUA) {
             flags |= BDRV_REQ_FUA;
         }
+        nbd_export_enter(client);
         ret = blk_pwrite(exp->blk, request->from + exp->dev_offset,
                          data, request->len, flags);
+        nbd_export_leave(client);
         return nbd_send_generic_reply(client, request->handle, ret,
                                       "writing to file failed", errp);
 
@@ -2296,8 +2378,10 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
         if (!(request->flags & NBD_CMD_FLAG_NO_HOLE)) {
             flags |= BDRV_REQ_MAY_UNMAP;
         }
+        nbd_export_enter(client);
         ret = blk_pwrite_zeroes(exp->blk, request->from + exp->dev_offset,
                                 request->len, flags);
+        nbd_export_leave(client);
         return nbd_send_generic_reply(client, request->handle, ret,
                                       "writing to file failed", errp);
 
@@ -2306,16 +2390,20 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
         abort();
 
     case NBD_CMD_FLUSH:
+        nbd_export_enter(client);
         ret = blk_co_flush(exp->blk);
+        nbd_export_leave(client);
         return nbd_send_generic_reply(client, request->handle, ret,
                                       "flush failed", errp);
 
     case NBD_CMD_TRIM:
+        nbd_export_enter(client);
         ret = blk_co_pdiscard(exp->blk, request->from + exp->dev_offset,
                               request->len);
         if (ret == 0 && request->flags & NBD_CMD_FLAG_FUA) {
             ret = blk_co_flush(exp->blk);
         }
+        nbd_export_leave(client);
         return nbd_send_generic_reply(client, request->handle, ret,
                                       "discard failed", errp);
 
@@ -2380,7 +2468,7 @@ static coroutine_fn void nbd_trip(void *opaque)
     Error *local_err = NULL;
 
     trace_nbd_trip();
-    if (client->closing) {
+    if (atomic_read(&client->closing)) {
         nbd_client_put(client);
         return;
     }
@@ -2389,7 +2477,7 @@ static coroutine_fn void nbd_trip(void *opaque)
     ret = nbd_co_receive_request(req, &request, &local_err);
     client->recv_coroutine = NULL;
 
-    if (client->closing) {
+    if (atomic_read(&client->closing)) {
         /*
          * The client may be closed when we are blocked in
          * nbd_co_receive_request()
@@ -2446,7 +2534,7 @@ static void nbd_client_receive_next_request(NBDClient *client)
     if (!client->recv_coroutine && client->nb_requests < MAX_NBD_REQUESTS) {
         nbd_client_get(client);
         client->recv_coroutine = qemu_coroutine_create(nbd_trip, client);
-        aio_co_schedule(client->exp->ctx, client->recv_coroutine);
+        aio_co_schedule(nbd_client_io_ctx(client), client->recv_coroutine);
     }
 }
 
@@ -2465,6 +2553,9 @@ static coroutine_fn void nbd_co_client_start(void *opaque)
         return;
     }
 
+    if (client->ctx) {
+        qio_channel_attach_aio_context(client->ioc, client->ctx);
+    }
     nbd_client_receive_next_request(client);
 }
 
@@ -2472,10 +2563,16 @@ static coroutine_fn void nbd_co_client_start(void *opaque)
  * Create a new client listener using the given channel @sioc.
  * Begin servicing it in a coroutine.  When the connection closes, call
  * @close_fn with an indication of whether the client completed negotiation.
+ *
+ * If @ctx is non-NULL, the channel is moved to @ctx once negotiation is
+ * over and requests are received and replied to there; only accesses to
+ * the export run in its own AioContext, which must not change.  If @ctx
+ * is NULL, the client follows the AioContext of the export.
  */
 void nbd_client_new(QIOChannelSocket *sioc,
                     QCryptoTLSCreds *tlscreds,
                     const char *tlsauthz,
+                    AioContext *ctx,
                     void (*close_fn)(NBDClient *, bool))
 {
     NBDClient *client;
@@ -2492,6 +2589,7 @@ void nbd_client_new(QIOChannelSocket *sioc,
     object_ref(OBJECT(client->sioc));
     client->ioc = QIO_CHANNEL(sioc);
     object_ref(OBJECT(client->ioc));
+    client->ctx = ctx;
     client->close_fn = close_fn;
 
     co = qemu_coroutine_create(nbd_co_client_start, client);
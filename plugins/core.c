@@ -0,0 +1,239 @@
+/*
+ * QEMU Plugin Core code
+ *
+ * This is the core code that keeps track of the callbacks registered by
+ * the loaded plugins and dispatches them.  Injection of the execution
+ * time callbacks into translated code lives in accel/tcg/plugin-gen.c.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/config-file.h"
+#include "qapi/error.h"
+#include "qemu/option.h"
+#include "qemu/rcu_queue.h"
+#include "hw/core/cpu.h"
+
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+#include "qemu/plugin.h"
+#include "plugin.h"
+
+struct qemu_plugin_state plugin;
+
+struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id)
+{
+    struct qemu_plugin_ctx *ctx;
+    qemu_plugin_id_t *id_p;
+
+    id_p = g_hash_table_lookup(plugin.id_ht, &id);
+    if (id_p == NULL) {
+        error_report("plugin: invalid plugin id %" PRIu64, id);
+        abort();
+    }
+    ctx = container_of(id_p, struct qemu_plugin_ctx, id);
+    return ctx;
+}
+
+static void plugin_flush_tb(void)
+{
+    /*
+     * Blocks translated before the callback was registered would miss
+     * its instrumentation.  tb_flush() defers the flush to a safe point.
+     */
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+static void do_plugin_register_cb(qemu_plugin_id_t id, enum qemu_plugin_event ev,
+                                  void *func, void *udata)
+{
+    struct qemu_plugin_ctx *ctx;
+    struct qemu_plugin_cb *cb;
+
+    qemu_mutex_lock(&plugin.lock);
+    ctx = plugin_id_to_ctx_locked(id);
+    cb = ctx->callbacks[ev];
+    if (cb) {
+        /*
+         * A plugin has a single callback per event: a second registration
+         * replaces the first one.  Callbacks are never freed, since a vCPU
+         * may be walking the list concurrently.
+         */
+        atomic_set(&cb->udata, udata);
+        atomic_set(&cb->f.generic, func);
+    } else if (func) {
+        cb = g_new(struct qemu_plugin_cb, 1);
+        cb->ctx = ctx;
+        cb->f.generic = func;
+        cb->udata = udata;
+        ctx->callbacks[ev] = cb;
+        QLIST_INSERT_HEAD_RCU(&plugin.cb_lists[ev], cb, entry);
+        if (ev == QEMU_PLUGIN_EV_VCPU_TB_TRANS) {
+            plugin_flush_tb();
+        }
+    }
+    qemu_mutex_unlock(&plugin.lock);
+}
+
+void plugin_register_cb(qemu_plugin_id_t id, enum qemu_plugin_event ev,
+                        void *func)
+{
+    do_plugin_register_cb(id, ev, func, NULL);
+}
+
+void
+plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
+                         void *func, void *udata)
+{
+    do_plugin_register_cb(id, ev, func, udata);
+}
+
+static void plugin_vcpu_cb__simple(CPUState *cpu, enum qemu_plugin_event ev)
+{
+    struct qemu_plugin_cb *cb;
+
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[ev], entry) {
+        qemu_plugin_vcpu_simple_cb_t func = atomic_read(&cb->f.vcpu_simple);
+
+        if (func) {
+            func(cb->ctx->id, cpu->cpu_index);
+        }
+    }
+}
+
+void qemu_plugin_vcpu_init_hook(CPUState *cpu)
+{
+    plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
+}
+
+void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
+{
+    plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
+}
+
+bool qemu_plugin_tb_trans_enabled(void)
+{
+    return !QLIST_EMPTY_RCU(&plugin.cb_lists[QEMU_PLUGIN_EV_VCPU_TB_TRANS]);
+}
+
+void qemu_plugin_tb_trans_cb(CPUState *cpu, struct qemu_plugin_tb *tb)
+{
+    struct qemu_plugin_cb *cb;
+
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[QEMU_PLUGIN_EV_VCPU_TB_TRANS],
+                      entry) {
+        qemu_plugin_vcpu_tb_trans_cb_t func = atomic_read(&cb->f.vcpu_tb_trans);
+
+        if (func) {
+            func(cb->ctx->id, tb);
+        }
+    }
+}
+
+static struct qemu_plugin_dyn_cb *plugin_get_dyn_cb(GArray **arr)
+{
+    GArray *cbs = *arr;
+
+    if (!cbs) {
+        cbs = g_array_sized_new(false, false,
+                                sizeof(struct qemu_plugin_dyn_cb), 1);
+        *arr = cbs;
+    }
+
+    g_array_set_size(cbs, cbs->len + 1);
+    return &g_array_index(cbs, struct qemu_plugin_dyn_cb, cbs->len - 1);
+}
+
+void plugin_register_inline_op(GArray **arr,
+                               enum qemu_plugin_mem_rw rw,
+                               enum qemu_plugin_op op, void *ptr,
+                               uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = ptr;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.ptr = ptr;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_dyn_cb__udata(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   enum qemu_plugin_cb_flags flags,
+                                   void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_REGULAR;
+}
+
+void plugin_register_vcpu_mem_cb(GArray **arr,
+                                 void *cb,
+                                 enum qemu_plugin_cb_flags flags,
+                                 enum qemu_plugin_mem_rw rw,
+                                 void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = udata;
+    dyn_cb->type = PLUGIN_CB_REGULAR;
+    dyn_cb->rw = rw;
+    dyn_cb->f.generic = cb;
+}
+
+void plugin_atexit_cb(void)
+{
+    struct qemu_plugin_cb *cb;
+
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[QEMU_PLUGIN_EV_ATEXIT], entry) {
+        qemu_plugin_udata_cb_t func = atomic_read(&cb->f.udata);
+
+        if (func) {
+            func(cb->ctx->id, cb->udata);
+        }
+    }
+}
+
+/*
+ * Execution-time helpers, called from the code generated by
+ * accel/tcg/plugin-gen.c.  The plugin callback and its user data are
+ * baked into the translated code as constants.
+ */
+void HELPER(plugin_vcpu_udata_cb)(uint32_t cpu_index, void *cb, void *udata)
+{
+    ((qemu_plugin_vcpu_udata_cb_t)cb)(cpu_index, udata);
+}
+
+void HELPER(plugin_vcpu_mem_cb)(uint32_t cpu_index, uint32_t info,
+                                uint64_t vaddr, void *cb, void *udata)
+{
+    ((qemu_plugin_vcpu_mem_cb_t)cb)(cpu_index, info, vaddr, udata);
+}
+
+static gboolean plugin_id_cmp(gconstpointer v1, gconstpointer v2)
+{
+    return *(qemu_plugin_id_t *)v1 == *(qemu_plugin_id_t *)v2;
+}
+
+static void __attribute__((__constructor__)) plugin_init(void)
+{
+    int i;
+
+    for (i = 0; i < QEMU_PLUGIN_EV_MAX; i++) {
+        QLIST_INIT(&plugin.cb_lists[i]);
+    }
+    qemu_mutex_init(&plugin.lock);
+    plugin.id_ht = g_hash_table_new(g_int64_hash, plugin_id_cmp);
+    QTAILQ_INIT(&plugin.ctxs);
+}
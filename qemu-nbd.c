@@ -41,6 +41,7 @@
 #include "qom/object_interfaces.h"
 #include "io/channel-socket.h"
 #include "io/net-listener.h"
+#include "sysemu/iothread.h"
 #include "crypto/init.h"
 #include "trace/control.h"
 #include "qemu-version.h"
@@ -62,6 +63,7 @@
 #define QEMU_NBD_OPT_FORK          263
 #define QEMU_NBD_OPT_TLSAUTHZ      264
 #define QEMU_NBD_OPT_PID_FILE      265
+#define QEMU_NBD_OPT_IOTHREADS     266
 
 #define MBR_SIZE 512
 
@@ -76,6 +78,9 @@ static int nb_fds;
 static QIONetListener *server;
 static QCryptoTLSCreds *tlscreds;
 static const char *tlsauthz;
+static IOThread **iothreads;
+static int nb_iothreads;
+static int next_iothread;
 
 static void usage(const char *name)
 {
@@ -93,6 +98,7 @@ static void usage(const char *name)
 "  -k, --socket=PATH         path to the unix socket\n"
 "                            (default '"SOCKET_PATH"')\n"
 "  -e, --shared=NUM          device can be shared by NUM clients (default '1')\n"
+"      --iothreads=NUM       serve clients from NUM I/O threads (default '0')\n"
 "  -t, --persistent          don't exit on the last connection\n"
 "  -v, --verbose             display extra debugging information\n"
 "  -x, --export-name=NAME    expose export by name (default is empty string)\n"
@@ -135,7 +141,7 @@ static void usage(const char *name)
 "                            '[ID_OR_NAME]'\n"
 "  -n, --nocache             disable host cache\n"
 "      --cache=MODE          set cache mode (none, writeback, ...)\n"
-"      --aio=MODE            set AIO mode (native or threads)\n"
+"      --aio=MODE            set AIO mode (native, io_uring or threads)\n"
 "      --discard=MODE        set discard mode (ignore, unmap)\n"
 "      --detect-zeroes=MODE  set detect-zeroes mode (off, on, unmap)\n"
 "      --image-opts          treat FILE as a full set of image options\n"
@@ -442,13 +448,21 @@ static void nbd_client_closed(NBDClient *client, bool negotiated)
 static void nbd_accept(QIONetListener *listener, QIOChannelSocket *cioc,
                        gpointer opaque)
 {
+    AioContext *ctx = NULL;
+
     if (state >= TERMINATE) {
         return;
     }
 
+    /* Spread the clients over the I/O threads, if any */
+    if (nb_iothreads) {
+        ctx = iothread_get_aio_context(iothreads[next_iothread]);
+        next_iothread = (next_iothread + 1) % nb_iothreads;
+    }
+
     nb_fds++;
     nbd_update_server_watch();
-    nbd_client_new(cioc, tlscreds, tlsauthz, nbd_client_closed);
+    nbd_client_new(cioc, tlscreds, tlsauthz, ctx, nbd_client_closed);
 }
 
 static void nbd_update_server_watch(void)
@@ -644,6 +658,7 @@ int main(int argc, char **argv)
         { "trace", required_argument, NULL, 'T' },
         { "fork", no_argument, NULL, QEMU_NBD_OPT_FORK },
         { "pid-file", required_argument, NULL, QEMU_NBD_OPT_PID_FILE },
+        { "iothreads", required_argument, NULL, QEMU_NBD_OPT_IOTHREADS },
         { NULL, 0, NULL, 0 }
     };
     int ch;
@@ -651,6 +666,7 @@ int main(int argc, char **argv)
     int flags = BDRV_O_RDWR;
     int partition = 0;
     int ret = 0;
+    int i;
     bool seen_cache = false;
     bool seen_discard = false;
     bool seen_aio = false;
@@ -718,13 +734,9 @@ int main(int argc, char **argv)
                 exit(EXIT_FAILURE);
             }
             seen_aio = true;
-            if (!strcmp(optarg, "native")) {
-                flags |= BDRV_O_NATIVE_AIO;
-            } else if (!strcmp(optarg, "threads")) {
-                /* this is the default */
-            } else {
-               error_report("invalid aio mode `%s'", optarg);
-               exit(EXIT_FAILURE);
+            if (bdrv_parse_aio(optarg, &flags) < 0) {
+                error_report("Invalid aio mode '%s'", optarg);
+                exit(EXIT_FAILURE);
             }
             break;
         case QEMU_NBD_OPT_DISCARD:
@@ -873,6 +885,13 @@ int main(int argc, char **argv)
         case QEMU_NBD_OPT_PID_FILE:
             pid_file_name = optarg;
             break;
+        case QEMU_NBD_OPT_IOTHREADS:
+            if (qemu_strtoi(optarg, NULL, 0, &nb_iothreads) < 0 ||
+                nb_iothreads < 0) {
+                error_report("Invalid number of I/O threads '%s'", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         }
     }
 
@@ -1172,11 +1191,29 @@ int main(int argc, char **argv)
         fd_size = limit;
     }
 
+    /*
+     * All clients are served from the same BlockDriverState, so a flush
+     * from any of them covers the writes completed by all of them.
+     */
+    if (shared > 1) {
+        nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
+    }
+
     export = nbd_export_new(bs, dev_offset, fd_size, export_name,
                             export_description, bitmap, nbdflags,
                             nbd_export_closed, writethrough, NULL,
                             &error_fatal);
 
+    if (nb_iothreads) {
+        iothreads = g_new(IOThread *, nb_iothreads);
+        for (i = 0; i < nb_iothreads; i++) {
+            char *id = g_strdup_printf("nbd-iothread-%d", i);
+
+            iothreads[i] = iothread_create(id, &error_fatal);
+            g_free(id);
+        }
+    }
+
     if (device) {
 #if HAVE_NBD_DEVICE
         int ret;
@@ -1222,6 +1259,11 @@ int main(int argc, char **argv)
         }
     } while (state != TERMINATED);
 
+    for (i = 0; i < nb_iothreads; i++) {
+        iothread_destroy(iothreads[i]);
+    }
+    g_free(iothreads);
+
     blk_unref(blk);
     if (sockpath) {
         unlink(sockpath);
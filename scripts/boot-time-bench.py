@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+#
+# Measure how long it takes to boot a Linux kernel on different machine types
+#
+# The kernel is booted with "reboot=t panic=-1" and QEMU is started with
+# -no-reboot, so that QEMU exits as soon as the guest reboots or panics.
+# Without a root filesystem the kernel panics right after mounting it
+# fails, so the measured time covers QEMU startup, machine setup and the
+# kernel boot up to userspace.  An initrd whose init reboots the guest
+# can be passed to include the start of userspace as well.
+#
+# Example:
+#   scripts/boot-time-bench.py -q x86_64-softmmu/qemu-system-x86_64 \
+#       -k vmlinux -m pc,microvm -n 20 -- -accel kvm
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+
+from __future__ import print_function
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+
+def boot_once(args, machine):
+    cmd = [args.qemu, '-machine', machine, '-kernel', args.kernel,
+           '-append', 'console=ttyS0 reboot=t panic=-1 ' + args.append,
+           '-m', args.memory, '-smp', str(args.smp),
+           '-no-reboot', '-nographic', '-nodefaults']
+    if args.initrd:
+        cmd += ['-initrd', args.initrd]
+    if args.console:
+        cmd += ['-serial', 'stdio']
+    cmd += args.extra
+
+    with open(os.devnull, 'w') as devnull:
+        start = time.time()
+        rc = subprocess.call(cmd, stdin=devnull,
+                             stdout=None if args.console else devnull)
+        end = time.time()
+    if rc != 0:
+        print('%s: QEMU exited with status %d' % (machine, rc),
+              file=sys.stderr)
+        sys.exit(1)
+    return end - start
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Measure the boot time of a Linux kernel on QEMU')
+    parser.add_argument('-q', '--qemu', required=True,
+                        help='QEMU system emulator binary')
+    parser.add_argument('-k', '--kernel', required=True,
+                        help='uncompressed kernel with a PVH ELF note')
+    parser.add_argument('-i', '--initrd', default=None,
+                        help='initrd to pass to the kernel')
+    parser.add_argument('-a', '--append', default='',
+                        help='extra kernel command line arguments')
+    parser.add_argument('-m', '--machines', default='pc,microvm',
+                        help='comma separated list of machine types')
+    parser.add_argument('-n', '--iterations', type=int, default=10,
+                        help='number of boots per machine type')
+    parser.add_argument('--memory', default='256M',
+                        help='guest RAM size')
+    parser.add_argument('--smp', type=int, default=1,
+                        help='number of vCPUs')
+    parser.add_argument('--console', action='store_true',
+                        help='show the guest serial console')
+    parser.add_argument('extra', nargs='*',
+                        help='extra QEMU arguments, after "--"')
+    args = parser.parse_args()
+
+    print('%-20s %10s %10s %10s' % ('machine', 'min (ms)', 'avg (ms)',
+                                     'max (ms)'))
+    for machine in args.machines.split(','):
+        times = [boot_once(args, machine) for i in range(args.iterations)]
+        print('%-20s %10.1f %10.1f %10.1f' %
+              (machine, min(times) * 1000,
+               sum(times) * 1000 / len(times), max(times) * 1000))
+
+
+if __name__ == '__main__':
+    main()
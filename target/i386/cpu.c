@@ -25,6 +25,7 @@
 
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "fpu/softfloat-helpers.h"
 #include "sysemu/kvm.h"
 #include "sysemu/reset.h"
 #include "sysemu/hvf.h"
@@ -4737,6 +4738,12 @@ static void x86_cpu_reset(CPUState *s)
     cpu_set_fpuc(env, 0x37f);
 
     env->mxcsr = 0x1f80;
+    /*
+     * x87 operations are done on floatx80, which has no hardfloat
+     * support, so fast FP mode only matters for SSE and 3DNow!.
+     */
+    set_float_fast_fp(cpu->fast_fp, &env->sse_status);
+    set_float_fast_fp(cpu->fast_fp, &env->mmx_status);
     /* All units are in INIT state.  */
     env->xstate_bv = 0;
 
@@ -5922,6 +5929,7 @@ static Property x86_cpu_properties[] = {
                      false),
     DEFINE_PROP_BOOL("vmware-cpuid-freq", X86CPU, vmware_cpuid_freq, true),
     DEFINE_PROP_BOOL("tcg-cpuid", X86CPU, expose_tcg, true),
+    DEFINE_PROP_BOOL("x-fast-fp", X86CPU, fast_fp, false),
     DEFINE_PROP_BOOL("x-migrate-smi-count", X86CPU, migrate_smi_count,
                      true),
     /*
@@ -167,6 +167,7 @@ typedef enum X86Seg {
 #define HF_IOBPT_SHIFT      24 /* an io breakpoint enabled */
 #define HF_MPX_EN_SHIFT     25 /* MPX Enabled (CR4+XCR0+BNDCFGx) */
 #define HF_MPX_IU_SHIFT     26 /* BND registers in-use */
+#define HF_FLATMEM_SHIFT    27 /* linear == physical, only in TB flags */
 
 #define HF_CPL_MASK          (3 << HF_CPL_SHIFT)
 #define HF_INHIBIT_IRQ_MASK  (1 << HF_INHIBIT_IRQ_SHIFT)
@@ -192,6 +193,7 @@ typedef enum X86Seg {
 #define HF_IOBPT_MASK        (1 << HF_IOBPT_SHIFT)
 #define HF_MPX_EN_MASK       (1 << HF_MPX_EN_SHIFT)
 #define HF_MPX_IU_MASK       (1 << HF_MPX_IU_SHIFT)
+#define HF_FLATMEM_MASK      (1 << HF_FLATMEM_SHIFT)
 
 /* hflags2 */
 
@@ -1202,8 +1204,9 @@ typedef struct CPUX86State {
     float_status mmx_status; /* for 3DNow! float ops */
     float_status sse_status;
     uint32_t mxcsr;
-    ZMMReg xmm_regs[CPU_NB_REGS == 8 ? 8 : 32];
-    ZMMReg xmm_t0;
+    /* Aligned so that translate.c can operate on them with gvec ops.  */
+    ZMMReg xmm_regs[CPU_NB_REGS == 8 ? 8 : 32] QEMU_ALIGNED(16);
+    ZMMReg xmm_t0 QEMU_ALIGNED(16);
     MMXReg mmx_t0;
 
     XMMReg ymmh_regs[CPU_NB_REGS];
@@ -1433,6 +1436,11 @@ struct X86CPU {
     bool force_features;
     bool expose_kvm;
     bool expose_tcg;
+    /*
+     * Let TCG use the host FPU for SSE even when the inexact flag is
+     * clear; the flag is then not raised reliably.
+     */
+    bool fast_fp;
     bool migratable;
     bool migrate_smi_count;
     bool max_features; /* Enable all supported features automatically */
@@ -1803,6 +1811,19 @@ static inline void cpu_get_tb_cpu_state(CPUX86State *env, target_ulong *pc,
     *pc = *cs_base + env->eip;
     *flags = env->hflags |
         (env->eflags & (IOPL_MASK | TF_MASK | RF_MASK | VM_MASK | AC_MASK));
+#ifndef CONFIG_USER_ONLY
+    /*
+     * With paging off and A20 enabled, linear addresses are physical
+     * addresses and loads may use the direct RAM window.  Watchpoints
+     * are implemented in the TLB, so they disable it too.
+     */
+    if (tcg_direct_ram &&
+        !(env->cr[0] & CR0_PG_MASK) && env->a20_mask == -1 &&
+        !(env->hflags & HF_SMM_MASK) && !(env->hflags2 & HF2_NPT_MASK) &&
+        QTAILQ_EMPTY(&env_cpu(env)->watchpoints)) {
+        *flags |= HF_FLATMEM_MASK;
+    }
+#endif
 }
 
 void do_cpu_init(X86CPU *cpu);
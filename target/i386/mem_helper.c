@@ -191,3 +191,205 @@ void helper_boundl(CPUX86State *env, target_ulong a0, int v)
         raise_exception_ra(env, EXCP05_BOUND, GETPC());
     }
 }
+
+/*
+ * rep movs and rep stos.  Each call handles the elements that lie within
+ * the current page of all operands with one host memory operation, or a
+ * single element when that is not possible, e.g. for MMIO or a backward
+ * copy.  The translator loops back to the instruction while ECX is not
+ * zero, so the instruction stays interruptible.
+ */
+static target_ulong rep_linear_addr(CPUX86State *env, int aflag, int seg,
+                                    target_ulong ofs)
+{
+    switch (aflag) {
+    case MO_16:
+        ofs &= 0xffff;
+        break;
+    case MO_32:
+        ofs = (uint32_t)ofs;
+        break;
+    }
+    if (seg < 0) {
+        return ofs;
+    }
+    if (aflag == MO_64 || (env->hflags & HF_CS64_MASK)) {
+        return ofs + env->segs[seg].base;
+    }
+    return (uint32_t)(ofs + env->segs[seg].base);
+}
+
+/* Bytes from @ofs to the end of its page and of the address space.  */
+static uint64_t rep_run_len(int aflag, target_ulong ofs, target_ulong addr)
+{
+    uint64_t len = -(addr | TARGET_PAGE_MASK);
+
+    switch (aflag) {
+    case MO_16:
+        len = MIN(len, 0x10000 - (ofs & 0xffff));
+        break;
+    case MO_32:
+        len = MIN(len, 0x100000000ULL - (uint32_t)ofs);
+        break;
+    }
+    return len;
+}
+
+static void rep_add_reg(CPUX86State *env, int aflag, int reg, target_long n)
+{
+    target_ulong val = env->regs[reg] + n;
+
+    switch (aflag) {
+    case MO_16:
+        env->regs[reg] = deposit64(env->regs[reg], 0, 16, val);
+        break;
+    case MO_32:
+        env->regs[reg] = (uint32_t)val;
+        break;
+    default:
+        env->regs[reg] = val;
+        break;
+    }
+}
+
+static uint64_t rep_count(CPUX86State *env, int aflag)
+{
+    switch (aflag) {
+    case MO_16:
+        return (uint16_t)env->regs[R_ECX];
+    case MO_32:
+        return (uint32_t)env->regs[R_ECX];
+    default:
+        return env->regs[R_ECX];
+    }
+}
+
+static uint64_t rep_ld(CPUX86State *env, target_ulong addr, int shift,
+                       uintptr_t ra)
+{
+    switch (shift) {
+    case MO_8:
+        return cpu_ldub_data_ra(env, addr, ra);
+    case MO_16:
+        return cpu_lduw_data_ra(env, addr, ra);
+    case MO_32:
+        return cpu_ldl_data_ra(env, addr, ra);
+    default:
+        return cpu_ldq_data_ra(env, addr, ra);
+    }
+}
+
+static void rep_st(CPUX86State *env, target_ulong addr, int shift,
+                   uint64_t val, uintptr_t ra)
+{
+    switch (shift) {
+    case MO_8:
+        cpu_stb_data_ra(env, addr, val, ra);
+        break;
+    case MO_16:
+        cpu_stw_data_ra(env, addr, val, ra);
+        break;
+    case MO_32:
+        cpu_stl_data_ra(env, addr, val, ra);
+        break;
+    default:
+        cpu_stq_data_ra(env, addr, val, ra);
+        break;
+    }
+}
+
+void helper_rep_movs(CPUX86State *env, uint32_t shift, uint32_t aflag,
+                     uint32_t sseg, uint32_t dseg)
+{
+    uintptr_t ra = GETPC();
+    int mmu_idx = cpu_mmu_index(env, false);
+    target_ulong src = rep_linear_addr(env, aflag, sseg, env->regs[R_ESI]);
+    target_ulong dst = rep_linear_addr(env, aflag, dseg, env->regs[R_EDI]);
+    uint64_t count = rep_count(env, aflag);
+    uint64_t len;
+
+    if (env->df == 1) {
+        len = MIN(rep_run_len(aflag, env->regs[R_ESI], src),
+                  rep_run_len(aflag, env->regs[R_EDI], dst));
+        if (count < (len >> shift)) {
+            len = count << shift;
+        }
+        len &= -(1ULL << shift);
+        if (len) {
+            uint8_t *hsrc = probe_access(env, src, len, MMU_DATA_LOAD,
+                                         mmu_idx, ra);
+            uint8_t *hdst = probe_access(env, dst, len, MMU_DATA_STORE,
+                                         mmu_idx, ra);
+
+            /*
+             * memmove matches an element-wise forward copy unless the
+             * destination starts inside the source.
+             */
+            if (hsrc && hdst && !(hdst > hsrc && hdst < hsrc + len)) {
+                memmove(hdst, hsrc, len);
+                rep_add_reg(env, aflag, R_ESI, len);
+                rep_add_reg(env, aflag, R_EDI, len);
+                rep_add_reg(env, aflag, R_ECX, -(target_long)(len >> shift));
+                return;
+            }
+        }
+    }
+
+    rep_st(env, dst, shift, rep_ld(env, src, shift, ra), ra);
+    rep_add_reg(env, aflag, R_ESI, env->df * (1 << shift));
+    rep_add_reg(env, aflag, R_EDI, env->df * (1 << shift));
+    rep_add_reg(env, aflag, R_ECX, -1);
+}
+
+void helper_rep_stos(CPUX86State *env, uint32_t shift, uint32_t aflag,
+                     uint32_t dseg)
+{
+    uintptr_t ra = GETPC();
+    int mmu_idx = cpu_mmu_index(env, false);
+    target_ulong dst = rep_linear_addr(env, aflag, dseg, env->regs[R_EDI]);
+    uint64_t count = rep_count(env, aflag);
+    uint64_t val = env->regs[R_EAX];
+    uint64_t len, i;
+
+    if (env->df == 1) {
+        len = rep_run_len(aflag, env->regs[R_EDI], dst);
+        if (count < (len >> shift)) {
+            len = count << shift;
+        }
+        len &= -(1ULL << shift);
+        if (len) {
+            uint8_t *hdst = probe_access(env, dst, len, MMU_DATA_STORE,
+                                         mmu_idx, ra);
+
+            if (hdst) {
+                switch (shift) {
+                case MO_8:
+                    memset(hdst, val, len);
+                    break;
+                case MO_16:
+                    for (i = 0; i < len; i += 2) {
+                        stw_le_p(hdst + i, val);
+                    }
+                    break;
+                case MO_32:
+                    for (i = 0; i < len; i += 4) {
+                        stl_le_p(hdst + i, val);
+                    }
+                    break;
+                default:
+                    for (i = 0; i < len; i += 8) {
+                        stq_le_p(hdst + i, val);
+                    }
+                    break;
+                }
+                rep_add_reg(env, aflag, R_EDI, len);
+                rep_add_reg(env, aflag, R_ECX, -(target_long)(len >> shift));
+                return;
+            }
+        }
+    }
+
+    rep_st(env, dst, shift, val, ra);
+    rep_add_reg(env, aflag, R_EDI, env->df * (1 << shift));
+    rep_add_reg(env, aflag, R_ECX, -1);
+}
@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -1212,6 +1213,51 @@ GEN_REPZ(outs)
 GEN_REPZ2(scas)
 GEN_REPZ2(cmps)
 
+/*
+ * Outside of icount and single-stepping, rep movs and rep stos call
+ * helpers that process a whole page of elements at a time.
+ */
+static bool gen_rep_bulk_ok(DisasContext *s)
+{
+    return s->jmp_opt && !(tb_cflags(s->base.tb) & CF_USE_ICOUNT);
+}
+
+/* The segment that gen_lea_v_seg adds to a string operand, or -1.  */
+static int gen_string_seg(DisasContext *s, int def_seg, int ovr_seg)
+{
+    if (ovr_seg < 0 && s->aflag != MO_64 && s->addseg) {
+        ovr_seg = def_seg;
+    }
+    return ovr_seg;
+}
+
+static void gen_rep_movs_bulk(DisasContext *s, TCGMemOp ot,
+                              target_ulong cur_eip, target_ulong next_eip)
+{
+    TCGLabel *l2;
+
+    gen_update_cc_op(s);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    gen_helper_rep_movs(cpu_env, tcg_const_i32(ot), tcg_const_i32(s->aflag),
+                        tcg_const_i32(gen_string_seg(s, R_DS, s->override)),
+                        tcg_const_i32(gen_string_seg(s, R_ES, -1)));
+    gen_op_jz_ecx(s, s->aflag, l2);
+    gen_jmp(s, cur_eip);
+}
+
+static void gen_rep_stos_bulk(DisasContext *s, TCGMemOp ot,
+                              target_ulong cur_eip, target_ulong next_eip)
+{
+    TCGLabel *l2;
+
+    gen_update_cc_op(s);
+    l2 = gen_jz_ecx_string(s, next_eip);
+    gen_helper_rep_stos(cpu_env, tcg_const_i32(ot), tcg_const_i32(s->aflag),
+                        tcg_const_i32(gen_string_seg(s, R_ES, -1)));
+    gen_op_jz_ecx(s, s->aflag, l2);
+    gen_jmp(s, cur_eip);
+}
+
 static void gen_helper_fp_arith_ST0_FT0(int op)
 {
     switch (op) {
@@ -3036,6 +3082,195 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0xdf] = AESNI_OP(aeskeygenassist),
 };
 
+/*
+ * @ofs is the offset of an MMXReg if @oprsz is 8, or of a ZMMReg if it
+ * is 16.  Return the offset of the low @oprsz bytes of the register.
+ * On big-endian hosts the low 128 bits of a ZMMReg are at its end, see
+ * ZMM_Q() in cpu.h.
+ */
+static inline uint32_t vec_low_offset(uint32_t ofs, uint32_t oprsz)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    if (oprsz == 16) {
+        return ofs + offsetof(ZMMReg, ZMM_Q(1));
+    }
+#endif
+    return ofs;
+}
+
+/*
+ * The integer and logical MMX/SSE operations below have a generic vector
+ * equivalent, which the backend can lower to host vector instructions.
+ * @oprsz is 8 for MMX and 16 for SSE registers; the upper half of the
+ * AVX registers is left alone, as the legacy SSE encodings require.
+ * Return false if the operation must go through its helper instead.
+ */
+static bool gen_sse_gvec(int b, uint32_t d_ofs, uint32_t s_ofs,
+                         uint32_t oprsz)
+{
+    d_ofs = vec_low_offset(d_ofs, oprsz);
+    s_ofs = vec_low_offset(s_ofs, oprsz);
+
+    switch (b) {
+    case 0x54: /* andps, andpd */
+    case 0xdb: /* pand */
+        tcg_gen_gvec_and(MO_64, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x55: /* andnps, andnpd */
+    case 0xdf: /* pandn */
+        tcg_gen_gvec_andc(MO_64, d_ofs, s_ofs, d_ofs, oprsz, oprsz);
+        break;
+    case 0x56: /* orps, orpd */
+    case 0xeb: /* por */
+        tcg_gen_gvec_or(MO_64, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x57: /* xorps, xorpd */
+    case 0xef: /* pxor */
+        tcg_gen_gvec_xor(MO_64, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xfc ... 0xfe: /* paddb, paddw, paddl */
+        tcg_gen_gvec_add(MO_8 + b - 0xfc, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xd4: /* paddq */
+        tcg_gen_gvec_add(MO_64, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xf8 ... 0xfb: /* psubb, psubw, psubl, psubq */
+        tcg_gen_gvec_sub(MO_8 + b - 0xf8, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xec ... 0xed: /* paddsb, paddsw */
+        tcg_gen_gvec_ssadd(MO_8 + b - 0xec, d_ofs, d_ofs, s_ofs,
+                           oprsz, oprsz);
+        break;
+    case 0xdc ... 0xdd: /* paddusb, paddusw */
+        tcg_gen_gvec_usadd(MO_8 + b - 0xdc, d_ofs, d_ofs, s_ofs,
+                           oprsz, oprsz);
+        break;
+    case 0xe8 ... 0xe9: /* psubsb, psubsw */
+        tcg_gen_gvec_sssub(MO_8 + b - 0xe8, d_ofs, d_ofs, s_ofs,
+                           oprsz, oprsz);
+        break;
+    case 0xd8 ... 0xd9: /* psubusb, psubusw */
+        tcg_gen_gvec_ussub(MO_8 + b - 0xd8, d_ofs, d_ofs, s_ofs,
+                           oprsz, oprsz);
+        break;
+    case 0x74 ... 0x76: /* pcmpeqb, pcmpeqw, pcmpeql */
+        tcg_gen_gvec_cmp(TCG_COND_EQ, MO_8 + b - 0x74, d_ofs, d_ofs, s_ofs,
+                         oprsz, oprsz);
+        break;
+    case 0x64 ... 0x66: /* pcmpgtb, pcmpgtw, pcmpgtl */
+        tcg_gen_gvec_cmp(TCG_COND_GT, MO_8 + b - 0x64, d_ofs, d_ofs, s_ofs,
+                         oprsz, oprsz);
+        break;
+    case 0xda: /* pminub */
+        tcg_gen_gvec_umin(MO_8, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xde: /* pmaxub */
+        tcg_gen_gvec_umax(MO_8, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xea: /* pminsw */
+        tcg_gen_gvec_smin(MO_16, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xee: /* pmaxsw */
+        tcg_gen_gvec_smax(MO_16, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0xd5: /* pmullw */
+        tcg_gen_gvec_mul(MO_16, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/* Likewise for the SSSE3 and SSE4 operations in the 0f 38 table.  */
+static bool gen_sse_gvec_0f38(int b, uint32_t d_ofs, uint32_t s_ofs,
+                              uint32_t oprsz)
+{
+    d_ofs = vec_low_offset(d_ofs, oprsz);
+    s_ofs = vec_low_offset(s_ofs, oprsz);
+
+    switch (b) {
+    case 0x1c ... 0x1e: /* pabsb, pabsw, pabsd */
+        tcg_gen_gvec_abs(MO_8 + b - 0x1c, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x29: /* pcmpeqq */
+        tcg_gen_gvec_cmp(TCG_COND_EQ, MO_64, d_ofs, d_ofs, s_ofs,
+                         oprsz, oprsz);
+        break;
+    case 0x37: /* pcmpgtq */
+        tcg_gen_gvec_cmp(TCG_COND_GT, MO_64, d_ofs, d_ofs, s_ofs,
+                         oprsz, oprsz);
+        break;
+    case 0x38: /* pminsb */
+        tcg_gen_gvec_smin(MO_8, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x39: /* pminsd */
+        tcg_gen_gvec_smin(MO_32, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3a: /* pminuw */
+        tcg_gen_gvec_umin(MO_16, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3b: /* pminud */
+        tcg_gen_gvec_umin(MO_32, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3c: /* pmaxsb */
+        tcg_gen_gvec_smax(MO_8, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3d: /* pmaxsd */
+        tcg_gen_gvec_smax(MO_32, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3e: /* pmaxuw */
+        tcg_gen_gvec_umax(MO_16, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x3f: /* pmaxud */
+        tcg_gen_gvec_umax(MO_32, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    case 0x40: /* pmulld */
+        tcg_gen_gvec_mul(MO_32, d_ofs, d_ofs, s_ofs, oprsz, oprsz);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Shift by immediate (0f 71-73 /op).  Counts larger than the element
+ * size clear the elements for logical shifts and fill them with the
+ * sign bit for arithmetic shifts.
+ */
+static bool gen_sse_gvec_shift_imm(int b, int op, int val, uint32_t ofs,
+                                   uint32_t oprsz)
+{
+    unsigned vece = MO_16 + ((b - 1) & 3);
+    int bits = 8 << vece;
+
+    ofs = vec_low_offset(ofs, oprsz);
+
+    switch (op) {
+    case 2: /* psrlw, psrld, psrlq */
+        if (val >= bits) {
+            tcg_gen_gvec_dup8i(ofs, oprsz, oprsz, 0);
+        } else {
+            tcg_gen_gvec_shri(vece, ofs, ofs, val, oprsz, oprsz);
+        }
+        break;
+    case 4: /* psraw, psrad */
+        tcg_gen_gvec_sari(vece, ofs, ofs, MIN(val, bits - 1), oprsz, oprsz);
+        break;
+    case 6: /* psllw, pslld, psllq */
+        if (val >= bits) {
+            tcg_gen_gvec_dup8i(ofs, oprsz, oprsz, 0);
+        } else {
+            tcg_gen_gvec_shli(vece, ofs, ofs, val, oprsz, oprsz);
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start, int rex_r)
 {
@@ -3453,6 +3688,22 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 goto unknown_op;
             }
             val = x86_ldub_code(env, s);
+            sse_fn_epp = sse_op_table2[((b - 1) & 3) * 8 +
+                                       (((modrm >> 3)) & 7)][b1];
+            if (!sse_fn_epp) {
+                goto unknown_op;
+            }
+            if (is_xmm) {
+                rm = (modrm & 7) | REX_B(s);
+                op2_offset = offsetof(CPUX86State,xmm_regs[rm]);
+            } else {
+                rm = (modrm & 7);
+                op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
+            }
+            if (gen_sse_gvec_shift_imm(b, (modrm >> 3) & 7, val, op2_offset,
+                                       is_xmm ? 16 : 8)) {
+                break;
+            }
             if (is_xmm) {
                 tcg_gen_movi_tl(s->T0, val);
                 tcg_gen_st32_tl(s->T0, cpu_env,
@@ -3470,18 +3721,6 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                                 offsetof(CPUX86State, mmx_t0.MMX_L(1)));
                 op1_offset = offsetof(CPUX86State,mmx_t0);
             }
-            sse_fn_epp = sse_op_table2[((b - 1) & 3) * 8 +
-                                       (((modrm >> 3)) & 7)][b1];
-            if (!sse_fn_epp) {
-                goto unknown_op;
-            }
-            if (is_xmm) {
-                rm = (modrm & 7) | REX_B(s);
-                op2_offset = offsetof(CPUX86State,xmm_regs[rm]);
-            } else {
-                rm = (modrm & 7);
-                op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
-            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op2_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op1_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -3758,6 +3997,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             if (sse_fn_epp == SSE_SPECIAL) {
                 goto unknown_op;
             }
+            if (gen_sse_gvec_0f38(b, op1_offset, op2_offset, b1 ? 16 : 8)) {
+                break;
+            }
 
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
@@ -4470,6 +4712,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, s->ptr0, s->ptr1, s->A0);
             break;
         default:
+            if (gen_sse_gvec(b, op1_offset, op2_offset, is_xmm ? 16 : 8)) {
+                break;
+            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -6345,7 +6590,10 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     case 0xa4: /* movsS */
     case 0xa5:
         ot = mo_b_d(b, dflag);
-        if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
+        if ((prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) && gen_rep_bulk_ok(s)) {
+            gen_rep_movs_bulk(s, ot, pc_start - s->cs_base,
+                              s->pc - s->cs_base);
+        } else if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
             gen_repz_movs(s, ot, pc_start - s->cs_base, s->pc - s->cs_base);
         } else {
             gen_movs(s, ot);
@@ -6355,7 +6603,10 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
     case 0xaa: /* stosS */
     case 0xab:
         ot = mo_b_d(b, dflag);
-        if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
+        if ((prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) && gen_rep_bulk_ok(s)) {
+            gen_rep_stos_bulk(s, ot, pc_start - s->cs_base,
+                              s->pc - s->cs_base);
+        } else if (prefixes & (PREFIX_REPZ | PREFIX_REPNZ)) {
             gen_repz_stos(s, ot, pc_start - s->cs_base, s->pc - s->cs_base);
         } else {
             gen_stos(s, ot);
@@ -8475,6 +8726,9 @@ static void i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu)
     dc->mem_index = 0;
 #ifdef CONFIG_SOFTMMU
     dc->mem_index = cpu_mmu_index(env, false);
+    if (flags & HF_FLATMEM_MASK) {
+        tcg_use_direct_ram();
+    }
 #endif
     dc->cpuid_features = env->features[FEAT_1_EDX];
     dc->cpuid_ext_features = env->features[FEAT_1_ECX];
@@ -231,6 +231,9 @@ static inline void tb_target_set_jmp_target(uintptr_t tc_ptr,
 
 #ifdef CONFIG_SOFTMMU
 #define TCG_TARGET_NEED_LDST_LABELS
+#if TCG_TARGET_REG_BITS == 64
+#define TCG_TARGET_DIRECT_RAM
+#endif
 #endif
 #define TCG_TARGET_NEED_POOL_LABELS
 
@@ -1777,6 +1777,43 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
                          offsetof(CPUTLBEntry, addend));
 }
 
+#ifdef TCG_TARGET_DIRECT_RAM
+/*
+ * Check that ADDRLO falls inside the direct RAM window and leave its host
+ * address in L1.  Accesses outside the window jump to the same slow path
+ * as a TLB miss, which then does the lookup in C.
+ */
+static void tcg_out_direct_ram_check(TCGContext *s, TCGReg addrlo,
+                                     TCGMemOp opc, tcg_insn_unit **label_ptr)
+{
+    const TCGReg r0 = TCG_REG_L0;
+    const TCGReg r1 = TCG_REG_L1;
+    TCGType ttype = TARGET_LONG_BITS == 64 ? TCG_TYPE_I64 : TCG_TYPE_I32;
+    uint64_t limit = s->direct_ram.size - (1 << (opc & MO_SIZE));
+
+    /* This zero-extends a 32-bit guest address.  */
+    tcg_out_mov(s, ttype, r1, addrlo);
+    if (s->direct_ram.start) {
+        tcg_out_movi(s, TCG_TYPE_I64, r0, s->direct_ram.start);
+        tgen_arithr(s, ARITH_SUB + P_REXW, r1, r0);
+    }
+
+    /* cmp $limit, r1; ja slow_path */
+    if (limit <= INT32_MAX) {
+        tgen_arithi(s, ARITH_CMP + P_REXW, r1, limit, 0);
+    } else {
+        tcg_out_movi(s, TCG_TYPE_I64, r0, limit);
+        tgen_arithr(s, ARITH_CMP + P_REXW, r1, r0);
+    }
+    tcg_out_opc(s, OPC_JCC_long + JCC_JA, 0, 0, 0);
+    label_ptr[0] = s->code_ptr;
+    s->code_ptr += 4;
+
+    tcg_out_movi(s, TCG_TYPE_I64, r0, (uintptr_t)s->direct_ram.host);
+    tgen_arithr(s, ARITH_ADD + P_REXW, r1, r0);
+}
+#endif
+
 /*
  * Record the context of a call to the out of line helper code for the slow path
  * for a load or store, so that we can later generate the correct helper code
@@ -2119,8 +2156,15 @@ static void tcg_out_qemu_ld(TCGContext *s, const TCGArg *args, bool is64)
 #if defined(CONFIG_SOFTMMU)
     mem_index = get_mmuidx(oi);
 
-    tcg_out_tlb_load(s, addrlo, addrhi, mem_index, opc,
-                     label_ptr, offsetof(CPUTLBEntry, addr_read));
+#ifdef TCG_TARGET_DIRECT_RAM
+    if (s->direct_ram.size && get_alignment_bits(opc) == 0) {
+        tcg_out_direct_ram_check(s, addrlo, opc, label_ptr);
+    } else
+#endif
+    {
+        tcg_out_tlb_load(s, addrlo, addrhi, mem_index, opc,
+                         label_ptr, offsetof(CPUTLBEntry, addr_read));
+    }
 
     /* TLB Hit.  */
     tcg_out_qemu_ld_direct(s, datalo, datahi, TCG_REG_L1, -1, 0, 0, is64, opc);
@@ -167,11 +167,32 @@ struct tcg_region_tree {
     /* padding to avoid false sharing is computed at run-time */
 };
 
+/*
+ * Once every region is in use, the oldest full regions are evicted to make
+ * room for new code; this is the number of regions evicted in one pass,
+ * expressed as a fraction of the total.
+ */
+#define TCG_REGION_EVICT_DIV 4
+
+struct tcg_region_info {
+    bool in_use; /* assigned to a TCG context */
+    bool full; /* filled up by a TCG context, may be evicted */
+    bool referenced; /* code run since the last eviction pass, see below */
+    uint64_t gen; /* generation in which the region filled up */
+    size_t size_full; /* contribution to agg_size_full */
+};
+
 /*
  * We divide code_gen_buffer into equally-sized "regions" that TCG threads
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Regions are also the unit of code cache eviction: when no region is free,
+ * tcg_region_evict() frees the regions that filled up first, instead of
+ * having to flush the whole cache.  A region whose code was run since the
+ * previous eviction pass is given a second chance, so that hot code tends
+ * to stay resident.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -184,9 +205,16 @@ struct tcg_region_state {
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
 
-    /* fields protected by the lock */
-    size_t current; /* current region index */
+    /* fields protected by the lock, except for info[].referenced */
+    struct tcg_region_info *info;
+    uint64_t gen; /* generation counter for info[].gen */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /* eviction statistics, protected by the lock */
+    size_t evict_passes;
+    size_t evicted;
+    size_t evicted_tbs;
+    size_t spared;
 };
 
 static struct tcg_region_state region;
@@ -399,22 +427,24 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
+            return region.n - 1;
         } else {
-            region_idx = offset / region.stride;
+            return offset / region.stride;
         }
     }
-    return region_trees + region_idx * tree_size;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -549,12 +579,18 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i;
+
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_info *ri = &region.info[i];
+
+        if (!ri->in_use && !ri->full) {
+            tcg_region_assign(s, i);
+            ri->in_use = true;
+            return false;
+        }
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
-    return false;
+    return true;
 }
 
 /*
@@ -564,13 +600,20 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 static bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /* read the region now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t old = tc_ptr_to_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
-        region.agg_size_full += size_full - TCG_HIGHWATER;
+        struct tcg_region_info *ri = &region.info[old];
+
+        ri->in_use = false;
+        ri->full = true;
+        ri->gen = region.gen++;
+        ri->size_full = size_full - TCG_HIGHWATER;
+        region.agg_size_full += ri->size_full;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -592,7 +635,8 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    memset(region.info, 0, region.n * sizeof(region.info[0]));
+    region.gen = 0;
     region.agg_size_full = 0;
 
     for (i = 0; i < n_ctxs; i++) {
@@ -606,47 +650,375 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Evict full regions, oldest first, until at least 1/TCG_REGION_EVICT_DIV
+ * of the regions are free.  @func is called on every TB of an evicted
+ * region; it must unlink the TB from the rest of the system, but must not
+ * call back into the region trees.
+ *
+ * Returns the number of free regions after eviction.  Zero means that every
+ * region is assigned to a TCG context, and that only a full flush can make
+ * room for new code.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    size_t target = MAX(region.n / TCG_REGION_EVICT_DIV, 1);
+    size_t n_free = 0;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.n; i++) {
+        if (!region.info[i].in_use && !region.info[i].full) {
+            n_free++;
+        }
+    }
+    if (n_free >= target) {
+        /* another vCPU's request already made room */
+        goto out;
+    }
+
+    region.evict_passes++;
+    while (n_free < target) {
+        struct tcg_region_info *ri = NULL;
+        struct tcg_region_tree *rt;
+        size_t victim = 0;
+
+        for (i = 0; i < region.n; i++) {
+            if (region.info[i].full &&
+                (ri == NULL || region.info[i].gen < ri->gen)) {
+                ri = &region.info[i];
+                victim = i;
+            }
+        }
+        if (ri == NULL) {
+            break;
+        }
+        /*
+         * Each region is spared at most once per pass, since its
+         * referenced flag is cleared and it becomes the youngest.
+         */
+        if (atomic_read(&ri->referenced)) {
+            atomic_set(&ri->referenced, false);
+            ri->gen = region.gen++;
+            region.spared++;
+            continue;
+        }
+
+        rt = region_trees + victim * tree_size;
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, func, user_data);
+        region.evicted_tbs += g_tree_nnodes(rt->tree);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        region.agg_size_full -= ri->size_full;
+        ri->size_full = 0;
+        ri->full = false;
+        region.evicted++;
+        n_free++;
+    }
+ out:
+    qemu_mutex_unlock(&region.lock);
+    return n_free;
+}
+
+/*
+ * Record that @tb was looked up for execution, which gives its region a
+ * second chance at the next eviction pass.  This is only a hint, so no
+ * lock is taken; the flag is read first to avoid needless cache line
+ * bouncing between vCPU threads.
+ */
+void tcg_tb_mark_referenced(const TranslationBlock *tb)
+{
+    size_t i = tc_ptr_to_region_idx(tb->tc.ptr);
+    struct tcg_region_info *ri = &region.info[i];
+
+    if (!atomic_read(&ri->referenced)) {
+        atomic_set(&ri->referenced, true);
+    }
+}
+
+void tcg_region_evict_counts(size_t *passes, size_t *regions, size_t *tbs,
+                             size_t *spared)
+{
+    qemu_mutex_lock(&region.lock);
+    *passes = region.evict_passes;
+    *regions = region.evicted;
+    *tbs = region.evicted_tbs;
+    *spared = region.spared;
+    qemu_mutex_unlock(&region.lock);
+}
+
 #ifdef CONFIG_USER_ONLY
-static size_t tcg_n_regions(void)
+/*
+ * The functions below let the persistent translation cache save the code
+ * of some regions and put it back, at the same address, in a later run of
+ * the same binary.
+ */
+size_t tcg_nb_regions(void)
 {
-    return 1;
+    return region.n;
 }
-#else
+
+/*
+ * Return the number of bytes of code at the start of region @i, or zero
+ * if the region is free, and set *@pstart to the start of the region.
+ * *@current tells whether the region is the one being filled up.
+ *
+ * Call with the mmap lock held.
+ */
+size_t tcg_region_code_size(size_t i, void **pstart, bool *current)
+{
+    struct tcg_region_info *ri = &region.info[i];
+    void *start, *end;
+    size_t used = 0;
+
+    tcg_region_bounds(i, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    if (ri->full) {
+        used = end - start;
+    } else if (ri->in_use) {
+        unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+        unsigned int j;
+
+        /* find the context that is filling up the region */
+        for (j = 0; j < n_ctxs; j++) {
+            const TCGContext *s = atomic_read(&tcg_ctxs[j]);
+
+            if (s->code_gen_buffer == start) {
+                used = (void *)atomic_read(&s->code_gen_ptr) - start;
+                break;
+            }
+        }
+    }
+    *current = ri->in_use;
+    qemu_mutex_unlock(&region.lock);
+
+    *pstart = start;
+    return used;
+}
+
+/*
+ * Claim region @i for @used bytes of code that were saved from it in an
+ * earlier run; the caller copies them to the returned address.  The region
+ * is marked full, unless @current is true and no code has been generated
+ * yet, in which case the TCG context goes on filling it up.
+ *
+ * Returns NULL if the region is not free or is too small.
+ */
+void *tcg_region_restore(size_t i, size_t used, bool current)
+{
+    TCGContext *s = tcg_ctx;
+    size_t cur = tc_ptr_to_region_idx(s->code_gen_buffer);
+    bool empty = s->code_gen_ptr == s->code_gen_buffer;
+    struct tcg_region_info *ri;
+    void *start, *end;
+
+    if (i >= region.n) {
+        return NULL;
+    }
+    ri = &region.info[i];
+    tcg_region_bounds(i, &start, &end);
+    if (used > end - start) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&region.lock);
+    if (ri->full || (ri->in_use && (i != cur || !empty))) {
+        start = NULL;
+        goto out;
+    }
+    if (current && empty) {
+        region.info[cur].in_use = false;
+        tcg_region_assign(s, i);
+        ri->in_use = true;
+        s->code_gen_ptr = start + used;
+        goto out;
+    }
+
+    ri->full = true;
+    if (ri->in_use) {
+        /* move the context away from its still empty region */
+        ri->in_use = false;
+        if (tcg_region_alloc__locked(s)) {
+            ri->in_use = true;
+            ri->full = false;
+            start = NULL;
+            goto out;
+        }
+    }
+    ri->gen = region.gen++;
+    ri->size_full = end - start - TCG_HIGHWATER;
+    region.agg_size_full += ri->size_full;
+ out:
+    qemu_mutex_unlock(&region.lock);
+    return start;
+}
+#endif /* CONFIG_USER_ONLY */
+
+/*
+ * Make a copy of tcg_init_ctx with its own region of the code buffer, and
+ * register it in tcg_ctxs[].  @max is the size of tcg_ctxs[].
+ */
+static TCGContext *tcg_ctx_clone(unsigned int max)
+{
+    TCGContext *s = g_malloc(sizeof(*s));
+    unsigned int i, n;
+    bool err;
+
+    *s = tcg_init_ctx;
+
+    /* Relink mem_base.  */
+    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
+        if (tcg_init_ctx.temps[i].mem_base) {
+            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
+            tcg_debug_assert(b >= 0 && b < n);
+            s->temps[i].mem_base = &s->temps[b];
+        }
+    }
+
+    /* The memory pool chunks belong to tcg_init_ctx */
+    s->pool_first = s->pool_current = s->pool_first_large = NULL;
+    s->pool_cur = s->pool_end = NULL;
+
+    /* Claim an entry in tcg_ctxs */
+    n = atomic_fetch_inc(&n_tcg_ctxs);
+    g_assert(n < max);
+    atomic_set(&tcg_ctxs[n], s);
+
+    qemu_mutex_lock(&region.lock);
+    err = tcg_region_initial_alloc__locked(s);
+    g_assert(!err);
+    qemu_mutex_unlock(&region.lock);
+    return s;
+}
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Number of TCG contexts that translate without the mmap_lock;
+ * see tcg_ctx_acquire().  With 0 or 1 all translation is serialized.
+ */
+unsigned int tcg_translators = 1;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    TCGContext **free;
+    unsigned int n_free;
+} tcg_pool;
+
+static __thread bool tcg_ctx_borrowed;
+
+static unsigned int tcg_pool_size(void)
+{
+    return tcg_translators > 1 ? tcg_translators : 0;
+}
+
+static void tcg_pool_init(void)
+{
+    unsigned int n = tcg_pool_size();
+    unsigned int i;
+
+    if (n == 0) {
+        return;
+    }
+    qemu_mutex_init(&tcg_pool.lock);
+    qemu_cond_init(&tcg_pool.cond);
+    tcg_pool.free = g_new(TCGContext *, n);
+    for (i = 0; i < n; i++) {
+        tcg_pool.free[i] = tcg_ctx_clone(n + 1);
+    }
+    tcg_pool.n_free = n;
+}
+
+bool tcg_ctx_pool_enabled(void)
+{
+    return tcg_pool_size() != 0;
+}
+
+/*
+ * Borrow one of the tcg_translators contexts for the current thread,
+ * waiting for one to be returned if all of them are in use.  Unlike
+ * tcg_init_ctx, which all threads share under the mmap_lock, a borrowed
+ * context has regions of its own and can generate code while other
+ * threads translate too.  It is returned with tcg_ctx_release().
+ */
+void tcg_ctx_acquire(void)
+{
+    tcg_debug_assert(!tcg_ctx_borrowed);
+
+    qemu_mutex_lock(&tcg_pool.lock);
+    while (tcg_pool.n_free == 0) {
+        qemu_cond_wait(&tcg_pool.cond, &tcg_pool.lock);
+    }
+    tcg_ctx = tcg_pool.free[--tcg_pool.n_free];
+    qemu_mutex_unlock(&tcg_pool.lock);
+    tcg_ctx_borrowed = true;
+}
+
+/*
+ * Give back the context taken by tcg_ctx_acquire(), if any, and go back
+ * to tcg_init_ctx.  Returns true if the thread had borrowed a context.
+ */
+bool tcg_ctx_release(void)
+{
+    if (!tcg_ctx_borrowed) {
+        return false;
+    }
+    tcg_ctx_borrowed = false;
+
+    qemu_mutex_lock(&tcg_pool.lock);
+    tcg_pool.free[tcg_pool.n_free++] = tcg_ctx;
+    qemu_cond_signal(&tcg_pool.cond);
+    qemu_mutex_unlock(&tcg_pool.lock);
+    tcg_ctx = &tcg_init_ctx;
+    return true;
+}
+#endif /* CONFIG_USER_ONLY */
+
 /*
  * It is likely that some vCPUs will translate more code than others, so we
- * first try to set more regions than max_cpus, with those regions being of
+ * first try to set more regions than TCG threads, with those regions being of
  * reasonable size. If that's not possible we make do by evenly dividing
- * the code_gen_buffer among the vCPUs.
+ * the code_gen_buffer among the threads.
+ *
+ * Having several regions is also what allows evicting part of the code
+ * cache, so we do the same even if there is a single TCG thread.
  */
 static size_t tcg_n_regions(void)
 {
+    unsigned int n_threads = 1;
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
 #if !defined(CONFIG_USER_ONLY)
     MachineState *ms = MACHINE(qdev_get_machine());
-    unsigned int max_cpus = ms->smp.max_cpus;
-#endif
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+
+    if (qemu_tcg_mttcg_enabled()) {
+        n_threads = ms->smp.max_cpus;
     }
+#else
+    n_threads += tcg_pool_size();
+#endif
 
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
-    /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    /* If we can't, then just allocate one region per thread */
+    return n_threads;
 }
-#endif
 
 /*
  * Initializes region partitioning.
@@ -659,22 +1031,26 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG there is a single TCG thread,
+ * which fills the regions one after the other.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
- * spawned by the guest corresponds to a vCPU thread) is only bounded by the
- * OS, and usually this number is huge (tens of thousands is not uncommon).
+ * In user-mode all vCPU threads share a single TCG context, which like in
+ * !MTTCG fills the regions one after the other.  Having a region per vCPU
+ * thread in user-mode is not supported, because the number of vCPU threads
+ * (recall that each thread spawned by the guest corresponds to a vCPU thread)
+ * is only bounded by the OS, and usually this number is huge (tens of
+ * thousands is not uncommon).
  * Thus, given this large bound on the number of vCPU threads and the fact
  * that code_gen_buffer is allocated at compile-time, we cannot guarantee
  * that the availability of at least one region per vCPU thread.
  *
- * However, this user-mode limitation is unlikely to be a significant problem
- * in practice. Multi-threaded guests share most if not all of their translated
- * code, which makes parallel code generation less appealing than in softmmu.
+ * Multi-threaded guests share most if not all of their translated code, so
+ * this is rarely a problem.  For those that do not, tcg_translators > 1
+ * adds that many contexts, each with regions of its own, which vCPU threads
+ * borrow to translate in parallel; see tcg_ctx_acquire().
  */
 void tcg_region_init(void)
 {
@@ -713,6 +1089,7 @@ void tcg_region_init(void)
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
     region.end -= page_size;
+    region.info = g_new0(struct tcg_region_info, region.n);
 
     /* set guard pages */
     for (i = 0; i < region.n; i++) {
@@ -726,13 +1103,17 @@ void tcg_region_init(void)
 
     tcg_region_trees_init();
 
-    /* In user-mode we support only one ctx, so do the initial allocation now */
+    /*
+     * In user-mode the contexts are not tied to threads, so do the initial
+     * allocation for all of them now.
+     */
 #ifdef CONFIG_USER_ONLY
     {
         bool err = tcg_region_initial_alloc__locked(tcg_ctx);
 
         g_assert(!err);
     }
+    tcg_pool_init();
 #endif
 }
 
@@ -760,31 +1141,8 @@ void tcg_register_thread(void)
 void tcg_register_thread(void)
 {
     MachineState *ms = MACHINE(qdev_get_machine());
-    TCGContext *s = g_malloc(sizeof(*s));
-    unsigned int i, n;
-    bool err;
-
-    *s = tcg_init_ctx;
-
-    /* Relink mem_base.  */
-    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
-        if (tcg_init_ctx.temps[i].mem_base) {
-            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
-            tcg_debug_assert(b >= 0 && b < n);
-            s->temps[i].mem_base = &s->temps[b];
-        }
-    }
-
-    /* Claim an entry in tcg_ctxs */
-    n = atomic_fetch_inc(&n_tcg_ctxs);
-    g_assert(n < ms->smp.max_cpus);
-    atomic_set(&tcg_ctxs[n], s);
 
-    tcg_ctx = s;
-    qemu_mutex_lock(&region.lock);
-    err = tcg_region_initial_alloc__locked(tcg_ctx);
-    g_assert(!err);
-    qemu_mutex_unlock(&region.lock);
+    tcg_ctx = tcg_ctx_clone(ms->smp.max_cpus);
 }
 #endif /* !CONFIG_USER_ONLY */
 
@@ -979,12 +1337,14 @@ void tcg_context_init(TCGContext *s)
     tcg_ctx = s;
     /*
      * In user-mode we simply share the init context among threads, since we
-     * use a single region. See the documentation tcg_region_init() for the
-     * reasoning behind this.
+     * do not use per-thread regions. See the documentation tcg_region_init() for the
+     * reasoning behind this.  The contexts used for parallel translation, if
+     * any, are added by tcg_region_init().
      * In softmmu we will have at most max_cpus TCG threads.
      */
 #ifdef CONFIG_USER_ONLY
-    tcg_ctxs = &tcg_ctx;
+    tcg_ctxs = g_new(TCGContext *, 1 + tcg_pool_size());
+    tcg_ctxs[0] = s;
     n_tcg_ctxs = 1;
 #else
     MachineState *ms = MACHINE(qdev_get_machine());
@@ -1121,11 +1481,46 @@ void tcg_func_start(TCGContext *s)
     s->goto_tb_issue_mask = 0;
 #endif
 
+    s->uses_host_ptr = false;
+#ifdef CONFIG_SOFTMMU
+    s->direct_ram.size = 0;
+#endif
+
     QTAILQ_INIT(&s->ops);
     QTAILQ_INIT(&s->free_ops);
     QSIMPLEQ_INIT(&s->labels);
 }
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * Called by the front end when the loads of the TB being translated use
+ * guest physical addresses in the system address space, and nothing
+ * (MMU, watchpoints, ...) needs to see them.  Loads that fall inside
+ * the window of tcg_direct_ram_get() then skip the TLB lookup if the
+ * backend supports it.  The window is copied into the TB's code, so
+ * all TBs are flushed whenever it changes.
+ */
+void tcg_use_direct_ram(void)
+{
+#ifdef TCG_TARGET_DIRECT_RAM
+    tcg_direct_ram_get(&tcg_ctx->direct_ram);
+#endif
+}
+#endif
+
+/*
+ * Code that embeds a pointer to host data, other than to the code buffer
+ * itself, is only valid in the process that generated it; note it so that
+ * it is not saved to the persistent translation cache.
+ */
+intptr_t tcg_host_ptr(intptr_t ptr)
+{
+    if (ptr && ((void *)ptr < region.start || (void *)ptr >= region.end)) {
+        tcg_ctx->uses_host_ptr = true;
+    }
+    return ptr;
+}
+
 static inline TCGTemp *tcg_temp_alloc(TCGContext *s)
 {
     int n = s->nb_temps++;
@@ -2483,6 +2878,29 @@ static void la_global_sync(TCGContext *s, int ng)
     }
 }
 
+/* liveness analysis: conditional branch: all temps are dead, globals
+   and local temps should be synced, but globals remain live on the
+   fall-through path.  */
+static void la_bb_sync(TCGContext *s, int ng, int nt)
+{
+    int i;
+
+    la_global_sync(s, ng);
+
+    for (i = ng; i < nt; ++i) {
+        if (s->temps[i].temp_local) {
+            int state = s->temps[i].state;
+            s->temps[i].state = state | TS_MEM;
+            if (state != TS_DEAD) {
+                continue;
+            }
+        } else {
+            s->temps[i].state = TS_DEAD;
+        }
+        la_reset_pref(&s->temps[i]);
+    }
+}
+
 /* liveness analysis: sync globals back to memory and kill.  */
 static void la_global_kill(TCGContext *s, int ng)
 {
@@ -2759,6 +3177,8 @@ static void liveness_pass_1(TCGContext *s)
             /* If end of basic block, update.  */
             if (def->flags & TCG_OPF_BB_EXIT) {
                 la_func_end(s, nb_globals, nb_temps);
+            } else if (def->flags & TCG_OPF_COND_BRANCH) {
+                la_bb_sync(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_BB_END) {
                 la_bb_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -2871,7 +3291,10 @@ static bool liveness_pass_2(TCGContext *s)
             nb_oargs = def->nb_oargs;
 
             /* Set flags similar to how calls require.  */
-            if (def->flags & TCG_OPF_BB_END) {
+            if (def->flags & TCG_OPF_COND_BRANCH) {
+                /* Like reading globals: sync_globals */
+                call_flags = TCG_CALL_NO_WRITE_GLOBALS;
+            } else if (def->flags & TCG_OPF_BB_END) {
                 /* Like writing globals: save_globals */
                 call_flags = 0;
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -3309,6 +3732,30 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
     save_globals(s, allocated_regs);
 }
 
+/* at a conditional branch, we assume all temporaries are dead and
+   all globals and local temps are synced to their location.  Globals
+   keep their registers: the fall-through path can go on using them,
+   while the branch target starts with a label and reloads them.  */
+static void tcg_reg_alloc_cbranch(TCGContext *s, TCGRegSet allocated_regs)
+{
+    int i;
+
+    sync_globals(s, allocated_regs);
+
+    for (i = s->nb_globals; i < s->nb_temps; i++) {
+        TCGTemp *ts = &s->temps[i];
+        if (ts->temp_local) {
+            if (ts->val_type != TEMP_VAL_DEAD) {
+                temp_sync(s, ts, allocated_regs, 0, 0);
+            }
+        } else {
+            /* The liveness analysis already ensures that temps are dead.
+               Keep an tcg_debug_assert for safety. */
+            tcg_debug_assert(ts->val_type == TEMP_VAL_DEAD);
+        }
+    }
+}
+
 /*
  * Specialized code generation for INDEX_op_movi_*.
  */
@@ -3661,7 +4108,9 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
         }
     }
 
-    if (def->flags & TCG_OPF_BB_END) {
+    if (def->flags & TCG_OPF_COND_BRANCH) {
+        tcg_reg_alloc_cbranch(s, i_allocated_regs);
+    } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
     } else {
         if (def->flags & TCG_OPF_CALL_CLOBBER) {
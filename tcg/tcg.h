@@ -665,6 +665,30 @@ typedef struct TCGProfile {
     int64_t table_op_count[NB_OPS];
 } TCGProfile;
 
+/*
+ * State of a superblock translation, see tb_gen_superblock().  The
+ * blocks of the superblock are translated one after the other; the exits
+ * of each block other than the last are rewritten by tcg_gen_goto_tb()
+ * and tcg_gen_exit_tb().
+ */
+typedef struct TCGSuperblock {
+    TranslationBlock *tb;       /* the superblock being built */
+    TranslationBlock *block;    /* the block being translated */
+    int index;                  /* index of @block in the superblock */
+    int next_exit;              /* exit to the next block, -1 if last */
+    TCGOp *splice;              /* where the next block will be moved */
+} TCGSuperblock;
+
+/*
+ * Guest RAM that qemu_ld can read at a fixed host offset instead of
+ * looking the address up in the softmmu TLB; see tcg_use_direct_ram().
+ */
+typedef struct TCGDirectRAM {
+    uint64_t start;             /* guest address of the window */
+    uint64_t size;              /* size of the window, 0 if none */
+    uint8_t *host;              /* host address of @start */
+} TCGDirectRAM;
+
 struct TCGContext {
     uint8_t *pool_cur, *pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
@@ -718,6 +742,12 @@ struct TCGContext {
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
+#ifdef CONFIG_PLUGIN
+    /* descriptors of the TB and insn being instrumented, if any */
+    struct qemu_plugin_tb *plugin_tb;
+    struct qemu_plugin_insn *plugin_insn;
+#endif
+
     /* These structures are private to tcg-target.inc.c.  */
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_HEAD(, TCGLabelQemuLdst) ldst_labels;
@@ -727,6 +757,15 @@ struct TCGContext {
 #endif
 
     TCGLabel *exitreq_label;
+    TCGSuperblock *superblock;
+
+    /* The code embeds a pointer to host data, see tcg_host_ptr() */
+    bool uses_host_ptr;
+
+#ifdef CONFIG_SOFTMMU
+    /* Window for the loads of the current TB, see tcg_use_direct_ram() */
+    TCGDirectRAM direct_ram;
+#endif
 
     TCGTempSet free_temps[TCG_TYPE_COUNT * 2];
     TCGTemp temps[TCG_MAX_TEMPS]; /* globals first, temps after */
@@ -878,19 +917,36 @@ static inline bool tcg_op_buf_full(void)
 
 /* pool based memory allocation */
 
-/* user-mode: mmap_lock must be held for tcg_malloc_internal. */
+/*
+ * user-mode: mmap_lock must be held for tcg_malloc_internal, unless @s was
+ * borrowed with tcg_ctx_acquire().
+ */
 void *tcg_malloc_internal(TCGContext *s, int size);
 void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data);
+void tcg_region_evict_counts(size_t *passes, size_t *regions, size_t *tbs,
+                             size_t *spared);
+#ifdef CONFIG_USER_ONLY
+size_t tcg_nb_regions(void);
+size_t tcg_region_code_size(size_t i, void **pstart, bool *current);
+void *tcg_region_restore(size_t i, size_t used, bool current);
+
+extern unsigned int tcg_translators;
+bool tcg_ctx_pool_enabled(void);
+void tcg_ctx_acquire(void);
+bool tcg_ctx_release(void);
+#endif
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
 
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
+void tcg_tb_mark_referenced(const TranslationBlock *tb);
 size_t tcg_tb_phys_invalidate_count(void);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
@@ -1059,6 +1115,9 @@ enum {
     TCG_OPF_NOT_PRESENT  = 0x20,
     /* Instruction operands are vectors.  */
     TCG_OPF_VECTOR       = 0x40,
+    /* Instruction is a conditional branch: globals stay live in registers
+       on the fall-through path.  */
+    TCG_OPF_COND_BRANCH  = 0x80,
 };
 
 typedef struct TCGOpDef {
@@ -1106,12 +1165,26 @@ TCGv_vec tcg_const_ones_vec(TCGType);
 TCGv_vec tcg_const_zeros_vec_matching(TCGv_vec);
 TCGv_vec tcg_const_ones_vec_matching(TCGv_vec);
 
+intptr_t tcg_host_ptr(intptr_t ptr);
+
+#ifdef CONFIG_SOFTMMU
+void tcg_use_direct_ram(void);
+
+/* accel/tcg/direct-ram.c */
+void tcg_direct_ram_init(void);
+void tcg_direct_ram_get(TCGDirectRAM *ram);
+#endif
+
 #if UINTPTR_MAX == UINT32_MAX
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
+# define tcg_const_ptr(x) \
+    ((TCGv_ptr)tcg_const_i32(tcg_host_ptr((intptr_t)(x))))
+# define tcg_const_local_ptr(x) \
+    ((TCGv_ptr)tcg_const_local_i32(tcg_host_ptr((intptr_t)(x))))
 #else
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
+# define tcg_const_ptr(x) \
+    ((TCGv_ptr)tcg_const_i64(tcg_host_ptr((intptr_t)(x))))
+# define tcg_const_local_ptr(x) \
+    ((TCGv_ptr)tcg_const_local_i64(tcg_host_ptr((intptr_t)(x))))
 #endif
 
 TCGLabel *gen_new_label(void);
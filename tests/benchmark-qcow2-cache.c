@@ -0,0 +1,120 @@
+/*
+ * qcow2 metadata cache lookup benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "sysemu/block-backend.h"
+#include "block/qcow2.h"
+
+#define TABLE_SIZE      (4 * KiB)
+#define NUM_LOOKUPS     4096
+
+static BlockDriverState *bs;
+
+/*
+ * Measure qcow2_cache_get()/qcow2_cache_put() on a cache holding
+ * @num_tables tables.  With @working_set equal to the cache size every
+ * lookup hits; with a larger working set lookups also have to evict the
+ * least recently used table (without I/O, since no table is dirty).
+ */
+static void run_cache_bench(int num_tables, int working_set, const char *kind)
+{
+    Qcow2Cache *c;
+    uint64_t *offsets;
+    uint64_t ops = 0;
+    void *table;
+    int i, ret;
+
+    c = qcow2_cache_create(bs, num_tables, TABLE_SIZE);
+    g_assert(c);
+
+    for (i = 0; i < num_tables; i++) {
+        ret = qcow2_cache_get_empty(bs, c, (uint64_t)(i + 1) * TABLE_SIZE,
+                                    &table);
+        g_assert_cmpint(ret, ==, 0);
+        qcow2_cache_put(c, &table);
+    }
+
+    offsets = g_new(uint64_t, NUM_LOOKUPS);
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        offsets[i] = (uint64_t)(g_test_rand_int_range(0, working_set) + 1) *
+                     TABLE_SIZE;
+    }
+
+    g_test_timer_start();
+    do {
+        for (i = 0; i < NUM_LOOKUPS; i++) {
+            ret = qcow2_cache_get_empty(bs, c, offsets[i], &table);
+            g_assert_cmpint(ret, ==, 0);
+            qcow2_cache_put(c, &table);
+        }
+        ops += NUM_LOOKUPS;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    g_print("%s: %6d tables: %" PRIu64 " lookups in %.2f secs: "
+            "%.1f ns/lookup\n", kind, num_tables, ops, g_test_timer_last(),
+            g_test_timer_last() * 1e9 / ops);
+
+    g_free(offsets);
+    qcow2_cache_destroy(c);
+}
+
+static void test_cache_hit(const void *opaque)
+{
+    int num_tables = (uintptr_t)opaque;
+
+    run_cache_bench(num_tables, num_tables, "hit");
+}
+
+static void test_cache_miss(const void *opaque)
+{
+    int num_tables = (uintptr_t)opaque;
+
+    run_cache_bench(num_tables, num_tables * 2, "mixed");
+}
+
+int main(int argc, char **argv)
+{
+    char img_path[] = "/tmp/qcow2-cache-bench.XXXXXX";
+    BlockBackend *blk;
+    QDict *options;
+    uintptr_t i;
+    char name[64];
+    int fd, ret;
+
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+    g_test_init(&argc, &argv, NULL);
+
+    fd = mkstemp(img_path);
+    g_assert(fd >= 0);
+    close(fd);
+    bdrv_img_create(img_path, "qcow2", NULL, NULL, NULL, 1 * TiB, 0, true,
+                    &error_abort);
+
+    options = qdict_new();
+    qdict_put_str(options, "driver", "qcow2");
+    blk = blk_new_open(img_path, NULL, options, BDRV_O_RDWR, &error_abort);
+    bs = blk_bs(blk);
+
+    for (i = 16; i <= 16384; i *= 4) {
+        snprintf(name, sizeof(name), "/qcow2/cache/hit-%" PRIuPTR, i);
+        g_test_add_data_func(name, (void *)i, test_cache_hit);
+        snprintf(name, sizeof(name), "/qcow2/cache/mixed-%" PRIuPTR, i);
+        g_test_add_data_func(name, (void *)i, test_cache_miss);
+    }
+
+    ret = g_test_run();
+
+    blk_unref(blk);
+    unlink(img_path);
+    return ret;
+}
@@ -0,0 +1,94 @@
+/*
+ * Count the guest memory accesses performed by translated code.
+ *
+ * Arguments:
+ *   "inline"          count with inline operations instead of callbacks
+ *   "r", "w" or "rw"  access types to count (default: rw)
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static uint64_t mem_count;
+static uint64_t store_count;
+static bool do_inline;
+static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    gchar *out;
+
+    if (do_inline) {
+        out = g_strdup_printf("mem accesses: %" PRIu64 "\n", mem_count);
+    } else {
+        out = g_strdup_printf("mem accesses: %" PRIu64 " (%" PRIu64
+                              " stores)\n", mem_count, store_count);
+    }
+    qemu_plugin_outs(out);
+    g_free(out);
+}
+
+static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
+                     uint64_t vaddr, void *udata)
+{
+    __atomic_fetch_add(&mem_count, 1, __ATOMIC_RELAXED);
+    if (qemu_plugin_mem_is_store(meminfo)) {
+        __atomic_fetch_add(&store_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        if (do_inline) {
+            qemu_plugin_register_vcpu_mem_inline(insn, rw,
+                                                 QEMU_PLUGIN_INLINE_ADD_U64,
+                                                 &mem_count, 1);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, NULL);
+        }
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "inline") == 0) {
+            do_inline = true;
+        } else if (strcmp(argv[i], "r") == 0) {
+            rw = QEMU_PLUGIN_MEM_R;
+        } else if (strcmp(argv[i], "w") == 0) {
+            rw = QEMU_PLUGIN_MEM_W;
+        } else if (strcmp(argv[i], "rw") == 0) {
+            rw = QEMU_PLUGIN_MEM_RW;
+        } else {
+            fprintf(stderr, "mem plugin: unknown argument '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
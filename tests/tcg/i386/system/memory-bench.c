@@ -0,0 +1,94 @@
+/*
+ * Guest memory load benchmark
+ *
+ * Runs with paging disabled and sums a buffer several times with loads
+ * of each size, reporting the TSC ticks taken by every pass.  Compare
+ * the results of -accel tcg,direct-ram=off and -accel tcg,direct-ram=on.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <inttypes.h>
+#include <minilib.h>
+
+#define BENCH_SIZE (1024 * 1024)
+#define BENCH_LOOPS 16
+
+__attribute__((aligned(4096)))
+static uint8_t bench_data[BENCH_SIZE];
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t sum8(void)
+{
+    const uint8_t *p = bench_data;
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < BENCH_SIZE; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static uint32_t sum16(void)
+{
+    const uint16_t *p = (const uint16_t *)bench_data;
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < BENCH_SIZE / 2; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static uint32_t sum32(void)
+{
+    const uint32_t *p = (const uint32_t *)bench_data;
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < BENCH_SIZE / 4; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static const struct {
+    const char *name;
+    uint32_t (*fn)(void);
+} benches[] = {
+    { "8-bit", sum8 },
+    { "16-bit", sum16 },
+    { "32-bit", sum32 },
+};
+
+int main(void)
+{
+    uint32_t check = 0;
+    int i, j;
+
+    for (i = 0; i < BENCH_SIZE; i++) {
+        bench_data[i] = i * 7 + (i >> 8);
+    }
+
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        uint64_t start = rdtsc();
+
+        for (j = 0; j < BENCH_LOOPS; j++) {
+            check += benches[i].fn();
+        }
+        ml_printf("%s loads: %lld ticks\n", benches[i].name,
+                  (long long)(rdtsc() - start));
+    }
+    ml_printf("checksum: %x\n", check);
+    return 0;
+}
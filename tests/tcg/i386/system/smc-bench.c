@@ -0,0 +1,81 @@
+/*
+ * Self-modifying code benchmark
+ *
+ * Measures the two costs a JIT running in the guest sees: stores to the
+ * data part of a page that also holds translated code, and rewriting
+ * code that has already been translated.  The TSC ticks of each phase
+ * are printed.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <inttypes.h>
+#include <minilib.h>
+
+#define PAGE_SIZE 4096
+#define DATA_OFFSET 2048
+#define DATA_WRITES (1024 * 1024)
+#define CODE_WRITES 4096
+
+/* The first half of the page holds code, the second half data.  */
+__attribute__((aligned(PAGE_SIZE)))
+static uint8_t smc_page[PAGE_SIZE];
+
+/* mov 4(%esp),%eax; inc %eax; ret */
+static const uint8_t smc_code[] = { 0x8b, 0x44, 0x24, 0x04, 0x40, 0xc3 };
+#define SMC_OP_OFFSET 4
+#define SMC_OP_INC 0x40
+#define SMC_OP_DEC 0x48
+
+typedef int (*smc_fn)(int);
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+int main(void)
+{
+    volatile uint8_t *page = smc_page;
+    smc_fn fn = (smc_fn)smc_page;
+    uint64_t start;
+    int i, sum = 0;
+
+    for (i = 0; i < sizeof(smc_code); i++) {
+        page[i] = smc_code[i];
+    }
+    if (fn(1) != 2) {
+        ml_printf("FAIL: bad initial code\n");
+        return 1;
+    }
+
+    /* Stores next to live code; the TB must survive them.  */
+    start = rdtsc();
+    for (i = 0; i < DATA_WRITES; i++) {
+        page[DATA_OFFSET + (i & (DATA_OFFSET - 1))] = i;
+    }
+    ml_printf("data writes: %lld ticks\n", (long long)(rdtsc() - start));
+    if (fn(1) != 2) {
+        ml_printf("FAIL: code changed by data writes\n");
+        return 1;
+    }
+
+    /* Rewrite the translated code and run it each time.  */
+    start = rdtsc();
+    for (i = 0; i < CODE_WRITES; i++) {
+        int inc = i & 1;
+
+        page[SMC_OP_OFFSET] = inc ? SMC_OP_INC : SMC_OP_DEC;
+        sum += fn(10) - (inc ? 11 : 9);
+    }
+    ml_printf("code writes: %lld ticks\n", (long long)(rdtsc() - start));
+    if (sum) {
+        ml_printf("FAIL: stale code executed %d times\n", sum);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Test rep movs and rep stos against element-wise reference copies,
+ * including page crossings, overlapping operands and DF=1.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BUF_SIZE (3 * 4096)
+
+static uint8_t buf[BUF_SIZE] __attribute__((aligned(4096)));
+static uint8_t ref[BUF_SIZE] __attribute__((aligned(4096)));
+static int errors;
+
+static void fill(void)
+{
+    int i;
+
+    for (i = 0; i < BUF_SIZE; i++) {
+        buf[i] = ref[i] = i * 37 + (i >> 9);
+    }
+}
+
+static void check(const char *name, int size, long dst, long src, long n,
+                  void *rdi, void *rsi, long rcx,
+                  void *exp_rdi, void *exp_rsi)
+{
+    if (memcmp(buf, ref, BUF_SIZE) || rcx != 0 ||
+        rdi != exp_rdi || (exp_rsi && rsi != exp_rsi)) {
+        printf("FAIL: %s%d dst %ld src %ld count %ld\n",
+               name, size, dst, src, n);
+        errors++;
+    }
+}
+
+static void ref_movs(int size, long dst, long src, long n, int down)
+{
+    long i;
+
+    for (i = 0; i < n * size; i += size) {
+        memcpy(ref + dst + (down ? -i : i), ref + src + (down ? -i : i), size);
+    }
+}
+
+static void test_movs(int size, long dst, long src, long n, int down)
+{
+    void *rdi = buf + dst, *rsi = buf + src;
+    long rcx = n;
+
+    fill();
+    ref_movs(size, dst, src, n, down);
+    if (down) {
+        asm volatile("std");
+    }
+    switch (size) {
+    case 1:
+        asm volatile("rep movsb" : "+D" (rdi), "+S" (rsi), "+c" (rcx)
+                     : : "memory");
+        break;
+    case 2:
+        asm volatile("rep movsw" : "+D" (rdi), "+S" (rsi), "+c" (rcx)
+                     : : "memory");
+        break;
+    case 4:
+        asm volatile("rep movsl" : "+D" (rdi), "+S" (rsi), "+c" (rcx)
+                     : : "memory");
+        break;
+    }
+    asm volatile("cld");
+    check("movs", size, dst, src, n, rdi, rsi, rcx,
+          buf + dst + (down ? -n : n) * size,
+          buf + src + (down ? -n : n) * size);
+}
+
+static void test_stos(int size, long dst, long n, int down)
+{
+    void *rdi = buf + dst;
+    uint32_t val = 0x89abcdef;
+    long i, rcx = n;
+
+    fill();
+    for (i = 0; i < n; i++) {
+        memcpy(ref + dst + (down ? -i : i) * size, &val, size);
+    }
+    if (down) {
+        asm volatile("std");
+    }
+    switch (size) {
+    case 1:
+        asm volatile("rep stosb" : "+D" (rdi), "+c" (rcx) : "a" (val)
+                     : "memory");
+        break;
+    case 2:
+        asm volatile("rep stosw" : "+D" (rdi), "+c" (rcx) : "a" (val)
+                     : "memory");
+        break;
+    case 4:
+        asm volatile("rep stosl" : "+D" (rdi), "+c" (rcx) : "a" (val)
+                     : "memory");
+        break;
+    }
+    asm volatile("cld");
+    check("stos", size, dst, 0, n, rdi, NULL, rcx,
+          buf + dst + (down ? -n : n) * size, NULL);
+}
+
+int main(void)
+{
+    static const long counts[] = { 1, 3, 64, 1000, 2048 };
+    int size, i;
+
+    for (size = 1; size <= 4; size *= 2) {
+        for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+            long n = counts[i];
+
+            /* disjoint, crossing pages, unaligned */
+            test_movs(size, 4096 - 5, 8192 + 3,
+                      n * size > 4000 ? 4000 / size : n, 0);
+            /* overlapping, destination below the source */
+            test_movs(size, 100, 100 + size * 3, n, 0);
+            /* overlapping, destination inside the source */
+            test_movs(size, 100 + size, 100, n, 0);
+            /* backwards */
+            test_movs(size, BUF_SIZE - 4096, BUF_SIZE - 16, n, 1);
+
+            test_stos(size, 4096 - 7, n, 0);
+            test_stos(size, BUF_SIZE - 8, n, 1);
+        }
+    }
+
+    if (errors) {
+        printf("%d errors\n", errors);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
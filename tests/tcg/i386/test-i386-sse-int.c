@@ -0,0 +1,286 @@
+/*
+ * Test the integer and logical MMX/SSE operations against reference
+ * implementations in C, for register and memory operands.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NR_VECTORS 64
+
+typedef union V128 {
+    uint8_t b[16];
+    uint16_t w[8];
+    uint32_t d[4];
+    uint64_t q[2];
+    int8_t sb[16];
+    int16_t sw[8];
+    int32_t sd[4];
+} __attribute__((aligned(16))) V128;
+
+typedef void (*vec_fn)(V128 *d, const V128 *s);
+typedef void (*ref_fn)(V128 *d, const V128 *s, int len);
+
+static V128 inputs[NR_VECTORS];
+static int errors;
+
+static int sat8(int x)
+{
+    return x < INT8_MIN ? INT8_MIN : x > INT8_MAX ? INT8_MAX : x;
+}
+
+static int sat16(int x)
+{
+    return x < INT16_MIN ? INT16_MIN : x > INT16_MAX ? INT16_MAX : x;
+}
+
+static int usat8(int x)
+{
+    return x < 0 ? 0 : x > UINT8_MAX ? UINT8_MAX : x;
+}
+
+static int usat16(int x)
+{
+    return x < 0 ? 0 : x > UINT16_MAX ? UINT16_MAX : x;
+}
+
+/* Reference implementations; @len is 8 for MMX and 16 for SSE */
+#define REF(name, type, field, expr)                            \
+    static void ref_##name(V128 *d, const V128 *s, int len)     \
+    {                                                           \
+        int i;                                                  \
+                                                                \
+        for (i = 0; i < len / (int)sizeof(type); i++) {         \
+            type a = d->field[i], b = s->field[i];              \
+            d->field[i] = (expr);                               \
+        }                                                       \
+    }
+
+REF(paddb, uint8_t, b, a + b)
+REF(paddw, uint16_t, w, a + b)
+REF(paddd, uint32_t, d, a + b)
+REF(paddq, uint64_t, q, a + b)
+REF(psubb, uint8_t, b, a - b)
+REF(psubw, uint16_t, w, a - b)
+REF(psubd, uint32_t, d, a - b)
+REF(psubq, uint64_t, q, a - b)
+REF(paddsb, int8_t, sb, sat8(a + b))
+REF(paddsw, int16_t, sw, sat16(a + b))
+REF(psubsb, int8_t, sb, sat8(a - b))
+REF(psubsw, int16_t, sw, sat16(a - b))
+REF(paddusb, uint8_t, b, usat8(a + b))
+REF(paddusw, uint16_t, w, usat16(a + b))
+REF(psubusb, uint8_t, b, usat8(a - b))
+REF(psubusw, uint16_t, w, usat16(a - b))
+REF(pcmpeqb, uint8_t, b, a == b ? UINT8_MAX : 0)
+REF(pcmpeqw, uint16_t, w, a == b ? UINT16_MAX : 0)
+REF(pcmpeqd, uint32_t, d, a == b ? UINT32_MAX : 0)
+REF(pcmpgtb, int8_t, sb, a > b ? -1 : 0)
+REF(pcmpgtw, int16_t, sw, a > b ? -1 : 0)
+REF(pcmpgtd, int32_t, sd, a > b ? -1 : 0)
+REF(pand, uint64_t, q, a & b)
+REF(pandn, uint64_t, q, ~a & b)
+REF(por, uint64_t, q, a | b)
+REF(pxor, uint64_t, q, a ^ b)
+REF(pminub, uint8_t, b, a < b ? a : b)
+REF(pmaxub, uint8_t, b, a > b ? a : b)
+REF(pminsw, int16_t, sw, a < b ? a : b)
+REF(pmaxsw, int16_t, sw, a > b ? a : b)
+REF(pmullw, int16_t, sw, (int16_t)(a * b))
+
+/* Shifts by immediate ignore the source operand */
+#define REF_SHIFT(name, type, field, expr)                      \
+    static void ref_##name(V128 *d, const V128 *s, int len)     \
+    {                                                           \
+        int i;                                                  \
+                                                                \
+        for (i = 0; i < len / (int)sizeof(type); i++) {         \
+            type a = d->field[i];                               \
+            d->field[i] = (expr);                               \
+        }                                                       \
+    }
+
+REF_SHIFT(psrlw_3, uint16_t, w, a >> 3)
+REF_SHIFT(psrlw_16, uint16_t, w, a >> 16)
+REF_SHIFT(psraw_5, int16_t, sw, a >> 5)
+REF_SHIFT(psraw_20, int16_t, sw, a >> 15)
+REF_SHIFT(psrld_31, uint32_t, d, a >> 31)
+REF_SHIFT(pslld_7, uint32_t, d, a << 7)
+REF_SHIFT(psrad_9, int32_t, sd, a >> 9)
+REF_SHIFT(psllq_33, uint64_t, q, a << 33)
+REF_SHIFT(psrlq_1, uint64_t, q, a >> 1)
+REF_SHIFT(psllw_17, uint16_t, w, (uint32_t)a << 17)
+
+#define SSE_OP(name, insn)                                      \
+    static void xmm_##name(V128 *d, const V128 *s)              \
+    {                                                           \
+        asm("movdqa %0, %%xmm2\n\t"                             \
+            "movdqa %1, %%xmm5\n\t"                             \
+            insn " %%xmm5, %%xmm2\n\t"                          \
+            "movdqa %%xmm2, %0"                                 \
+            : "+m" (*d) : "m" (*s) : "xmm2", "xmm5");           \
+    }                                                           \
+    static void xmm_mem_##name(V128 *d, const V128 *s)          \
+    {                                                           \
+        asm("movdqa %0, %%xmm3\n\t"                             \
+            insn " %1, %%xmm3\n\t"                              \
+            "movdqa %%xmm3, %0"                                 \
+            : "+m" (*d) : "m" (*s) : "xmm3");                   \
+    }                                                           \
+    static void mmx_##name(V128 *d, const V128 *s)              \
+    {                                                           \
+        asm("movq %0, %%mm1\n\t"                                \
+            "movq %1, %%mm6\n\t"                                \
+            insn " %%mm6, %%mm1\n\t"                            \
+            "movq %%mm1, %0\n\t"                                \
+            "emms"                                              \
+            : "+m" (d->q[0]) : "m" (s->q[0]) : "mm1", "mm6");   \
+    }
+
+#define SHIFT_OP(name, insn, imm)                               \
+    static void xmm_##name(V128 *d, const V128 *s)              \
+    {                                                           \
+        asm("movdqa %0, %%xmm4\n\t"                             \
+            insn " $" #imm ", %%xmm4\n\t"                       \
+            "movdqa %%xmm4, %0"                                 \
+            : "+m" (*d) : : "xmm4");                            \
+    }                                                           \
+    static void mmx_##name(V128 *d, const V128 *s)              \
+    {                                                           \
+        asm("movq %0, %%mm2\n\t"                                \
+            insn " $" #imm ", %%mm2\n\t"                        \
+            "movq %%mm2, %0\n\t"                                \
+            "emms"                                              \
+            : "+m" (d->q[0]) : : "mm2");                        \
+    }
+
+SSE_OP(paddb, "paddb")
+SSE_OP(paddw, "paddw")
+SSE_OP(paddd, "paddd")
+SSE_OP(paddq, "paddq")
+SSE_OP(psubb, "psubb")
+SSE_OP(psubw, "psubw")
+SSE_OP(psubd, "psubd")
+SSE_OP(psubq, "psubq")
+SSE_OP(paddsb, "paddsb")
+SSE_OP(paddsw, "paddsw")
+SSE_OP(psubsb, "psubsb")
+SSE_OP(psubsw, "psubsw")
+SSE_OP(paddusb, "paddusb")
+SSE_OP(paddusw, "paddusw")
+SSE_OP(psubusb, "psubusb")
+SSE_OP(psubusw, "psubusw")
+SSE_OP(pcmpeqb, "pcmpeqb")
+SSE_OP(pcmpeqw, "pcmpeqw")
+SSE_OP(pcmpeqd, "pcmpeqd")
+SSE_OP(pcmpgtb, "pcmpgtb")
+SSE_OP(pcmpgtw, "pcmpgtw")
+SSE_OP(pcmpgtd, "pcmpgtd")
+SSE_OP(pand, "pand")
+SSE_OP(pandn, "pandn")
+SSE_OP(por, "por")
+SSE_OP(pxor, "pxor")
+SSE_OP(pminub, "pminub")
+SSE_OP(pmaxub, "pmaxub")
+SSE_OP(pminsw, "pminsw")
+SSE_OP(pmaxsw, "pmaxsw")
+SSE_OP(pmullw, "pmullw")
+
+SHIFT_OP(psrlw_3, "psrlw", 3)
+SHIFT_OP(psrlw_16, "psrlw", 16)
+SHIFT_OP(psraw_5, "psraw", 5)
+SHIFT_OP(psraw_20, "psraw", 20)
+SHIFT_OP(psrld_31, "psrld", 31)
+SHIFT_OP(pslld_7, "pslld", 7)
+SHIFT_OP(psrad_9, "psrad", 9)
+SHIFT_OP(psllq_33, "psllq", 33)
+SHIFT_OP(psrlq_1, "psrlq", 1)
+SHIFT_OP(psllw_17, "psllw", 17)
+
+#define OP(name) { #name, xmm_##name, xmm_mem_##name, mmx_##name, ref_##name }
+#define SHIFT(name) { #name, xmm_##name, NULL, mmx_##name, ref_##name }
+
+static const struct {
+    const char *name;
+    vec_fn xmm;
+    vec_fn xmm_mem;
+    vec_fn mmx;
+    ref_fn ref;
+} ops[] = {
+    OP(paddb), OP(paddw), OP(paddd), OP(paddq),
+    OP(psubb), OP(psubw), OP(psubd), OP(psubq),
+    OP(paddsb), OP(paddsw), OP(psubsb), OP(psubsw),
+    OP(paddusb), OP(paddusw), OP(psubusb), OP(psubusw),
+    OP(pcmpeqb), OP(pcmpeqw), OP(pcmpeqd),
+    OP(pcmpgtb), OP(pcmpgtw), OP(pcmpgtd),
+    OP(pand), OP(pandn), OP(por), OP(pxor),
+    OP(pminub), OP(pmaxub), OP(pminsw), OP(pmaxsw), OP(pmullw),
+    SHIFT(psrlw_3), SHIFT(psrlw_16), SHIFT(psraw_5), SHIFT(psraw_20),
+    SHIFT(psrld_31), SHIFT(pslld_7), SHIFT(psrad_9),
+    SHIFT(psllq_33), SHIFT(psrlq_1), SHIFT(psllw_17),
+};
+
+static void check(const char *name, const char *form, vec_fn fn, ref_fn ref,
+                  const V128 *a, const V128 *b, int len)
+{
+    V128 d = *a, expected = *a;
+
+    ref(&expected, b, len);
+    fn(&d, b);
+    /* MMX operations leave the upper half of the buffer alone */
+    if (memcmp(&d, &expected, sizeof(d))) {
+        printf("FAIL: %s %s: %016llx%016llx op %016llx%016llx = "
+               "%016llx%016llx, expected %016llx%016llx\n", name, form,
+               (unsigned long long)a->q[1], (unsigned long long)a->q[0],
+               (unsigned long long)b->q[1], (unsigned long long)b->q[0],
+               (unsigned long long)d.q[1], (unsigned long long)d.q[0],
+               (unsigned long long)expected.q[1],
+               (unsigned long long)expected.q[0]);
+        errors++;
+    }
+}
+
+static void init_inputs(void)
+{
+    static const uint8_t edges[] = { 0x00, 0x01, 0x7f, 0x80, 0x81, 0xff };
+    uint32_t x = 0x12345678;
+    int i, j;
+
+    for (i = 0; i < NR_VECTORS; i++) {
+        for (j = 0; j < 16; j++) {
+            /* xorshift32, with some edge values mixed in */
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            inputs[i].b[j] = (x & 0x300) ? x : edges[(x >> 16) % 6];
+        }
+    }
+    /* equal elements for the comparisons */
+    inputs[1] = inputs[0];
+}
+
+int main(void)
+{
+    int i, j;
+
+    init_inputs();
+    for (i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+        for (j = 0; j < NR_VECTORS; j++) {
+            const V128 *a = &inputs[j], *b = &inputs[j ^ 1];
+
+            check(ops[i].name, "xmm", ops[i].xmm, ops[i].ref, a, b, 16);
+            if (ops[i].xmm_mem) {
+                check(ops[i].name, "xmm, mem", ops[i].xmm_mem, ops[i].ref,
+                      a, b, 16);
+            }
+            check(ops[i].name, "mm", ops[i].mmx, ops[i].ref, a, b, 8);
+        }
+    }
+
+    printf("%s\n", errors ? "FAIL" : "PASS");
+    return errors ? 1 : 0;
+}
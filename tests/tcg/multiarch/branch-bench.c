@@ -0,0 +1,103 @@
+/*
+ * Branch-heavy code benchmark
+ *
+ * The inner loops keep a handful of guest registers busy across
+ * conditional branches, which is where the TCG register allocator used
+ * to spill and reload every global.  The elapsed time is printed so that
+ * builds of QEMU can be compared; the checksum doubles as a
+ * correctness check.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DATA_SIZE 4096
+#define LOOPS 256
+
+static uint32_t data[DATA_SIZE];
+
+static uint32_t classify(const uint32_t *p, int n)
+{
+    uint32_t small = 0, big = 0, odd = 0, max = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t v = p[i];
+
+        if (v < 0x40000000) {
+            small++;
+        } else if (v > 0xc0000000) {
+            big++;
+        }
+        if (v & 1) {
+            odd += v >> 3;
+        }
+        if (v > max) {
+            max = v;
+        }
+    }
+    return small * 3 + big * 5 + odd + max;
+}
+
+static uint32_t search(const uint32_t *p, int n, uint32_t key)
+{
+    int lo = 0, hi = n - 1;
+    uint32_t steps = 0;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        steps++;
+        if (p[mid] == key) {
+            return steps;
+        } else if (p[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return steps + 0x10000;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int main(void)
+{
+    struct timespec start, end;
+    uint32_t seed = 1, check = 0;
+    int64_t ns;
+    int i, j;
+
+    for (i = 0; i < DATA_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < LOOPS; j++) {
+        check += classify(data, DATA_SIZE);
+    }
+    qsort(data, DATA_SIZE, sizeof(data[0]), cmp_u32);
+    for (j = 0; j < LOOPS; j++) {
+        for (i = 0; i < DATA_SIZE; i += 7) {
+            check += search(data, DATA_SIZE, data[i] + (j & 1));
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+         (end.tv_nsec - start.tv_nsec);
+    printf("branch-bench: %lld us, checksum %08x\n",
+           (long long)(ns / 1000), check);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Translation scaling benchmark
+ *
+ * Every thread runs code of its own, once, so that the run time is
+ * dominated by translation.  Compare the elapsed time of runs with
+ * different values of -tcg-threads; the checksum doubles as a
+ * correctness check.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NR_THREADS 8
+#define FUNCS_PER_THREAD 32
+
+typedef uint32_t (*func_t)(uint32_t);
+
+/*
+ * Each function has a different constant folded into every step, so
+ * that no two of them translate to the same code.
+ */
+#define FUNC(n)                                                 \
+    static __attribute__((noinline)) uint32_t func_##n(uint32_t x) \
+    {                                                           \
+        int i;                                                  \
+                                                                \
+        for (i = 0; i < 4; i++) {                               \
+            x ^= (n) * 0x9e3779b9u;                             \
+            x = (x << ((n) % 13 + 1)) | (x >> (31 - (n) % 13)); \
+            if (x & (1u << ((n) % 32))) {                       \
+                x += (n) * 0x85ebca6bu;                         \
+            } else {                                            \
+                x -= (n) ^ 0xc2b2ae35u;                         \
+            }                                                   \
+            x *= (n) | 1;                                       \
+        }                                                       \
+        return x;                                               \
+    }
+
+#define FUNC4(n)  FUNC(n##0) FUNC(n##1) FUNC(n##2) FUNC(n##3)
+#define FUNC16(n) FUNC4(n##0) FUNC4(n##1) FUNC4(n##2) FUNC4(n##3)
+#define FUNC64(n) FUNC16(n##0) FUNC16(n##1) FUNC16(n##2) FUNC16(n##3)
+
+/* func_10000 ... func_13333, in base 4 */
+FUNC64(10) FUNC64(11) FUNC64(12) FUNC64(13)
+
+#define REF(n)    func_##n,
+#define REF4(n)   REF(n##0) REF(n##1) REF(n##2) REF(n##3)
+#define REF16(n)  REF4(n##0) REF4(n##1) REF4(n##2) REF4(n##3)
+#define REF64(n)  REF16(n##0) REF16(n##1) REF16(n##2) REF16(n##3)
+
+static const func_t funcs[NR_THREADS * FUNCS_PER_THREAD] = {
+    REF64(10) REF64(11) REF64(12) REF64(13)
+};
+
+static uint32_t results[NR_THREADS];
+
+static void *worker(void *arg)
+{
+    uintptr_t t = (uintptr_t)arg;
+    uint32_t x = t;
+    int i;
+
+    for (i = 0; i < FUNCS_PER_THREAD; i++) {
+        x = funcs[t * FUNCS_PER_THREAD + i](x);
+    }
+    results[t] = x;
+    return NULL;
+}
+
+static uint32_t run(int nr_threads)
+{
+    pthread_t threads[NR_THREADS];
+    uint32_t sum = 0;
+    uintptr_t t;
+
+    for (t = 0; t < nr_threads; t++) {
+        if (pthread_create(&threads[t], NULL, worker, (void *)t)) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (t = 0; t < nr_threads; t++) {
+        pthread_join(threads[t], NULL);
+        sum = sum * 31 + results[t];
+    }
+    return sum;
+}
+
+static uint32_t run_serial(void)
+{
+    uint32_t sum = 0;
+    uintptr_t t;
+
+    for (t = 0; t < NR_THREADS; t++) {
+        worker((void *)t);
+        sum = sum * 31 + results[t];
+    }
+    return sum;
+}
+
+int main(void)
+{
+    struct timespec start, end;
+    uint32_t expected, sum;
+    double elapsed;
+
+    /* the threads translate code that the serial run has not touched */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sum = run(NR_THREADS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    expected = run_serial();
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+              (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d threads, %d functions: checksum %08x, %.3f s\n",
+           NR_THREADS, NR_THREADS * FUNCS_PER_THREAD, sum, elapsed);
+
+    if (sum != expected) {
+        fprintf(stderr, "checksum mismatch: expected %08x\n", expected);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+/*
+ * Block status cache tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "block/block_int.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+
+#define TEST_IMAGE_SIZE (64 * 1024 * 1024)
+
+typedef struct BDRVTestState {
+    int block_status_calls;
+    int status;
+} BDRVTestState;
+
+static int coroutine_fn bdrv_test_co_block_status(BlockDriverState *bs,
+                                                  bool want_zero,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  int64_t *pnum,
+                                                  int64_t *map,
+                                                  BlockDriverState **file)
+{
+    BDRVTestState *s = bs->opaque;
+
+    s->block_status_calls++;
+    *pnum = bytes;
+    *map = offset;
+    *file = bs;
+    return s->status | BDRV_BLOCK_OFFSET_VALID;
+}
+
+static int coroutine_fn bdrv_test_co_pwritev(BlockDriverState *bs,
+                                             uint64_t offset, uint64_t bytes,
+                                             QEMUIOVector *qiov, int flags)
+{
+    return 0;
+}
+
+static int64_t bdrv_test_getlength(BlockDriverState *bs)
+{
+    return TEST_IMAGE_SIZE;
+}
+
+static int bdrv_test_make_empty(BlockDriverState *bs)
+{
+    BDRVTestState *s = bs->opaque;
+
+    s->status = 0;
+    return 0;
+}
+
+static BlockDriver bdrv_test = {
+    .format_name            = "test",
+    .instance_size          = sizeof(BDRVTestState),
+
+    .bdrv_co_block_status   = bdrv_test_co_block_status,
+    .bdrv_co_pwritev        = bdrv_test_co_pwritev,
+    .bdrv_getlength         = bdrv_test_getlength,
+    .bdrv_make_empty        = bdrv_test_make_empty,
+};
+
+static BlockBackend *test_setup(BlockDriverState **pbs, uint64_t shared)
+{
+    BlockBackend *blk;
+    BlockDriverState *bs;
+
+    blk = blk_new(qemu_get_aio_context(),
+                  BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE, shared);
+    bs = bdrv_new_open_driver(&bdrv_test, "test-node", BDRV_O_RDWR,
+                              &error_abort);
+    blk_insert_bs(blk, bs, &error_abort);
+    bdrv_unref(bs);
+
+    *pbs = bs;
+    return blk;
+}
+
+static void test_hit(void)
+{
+    BlockDriverState *bs, *file;
+    BlockBackend *blk = test_setup(&bs, BLK_PERM_ALL);
+    BDRVTestState *s = bs->opaque;
+    int64_t pnum, map;
+    int ret;
+
+    s->status = BDRV_BLOCK_DATA;
+
+    ret = bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(ret, ==, BDRV_BLOCK_DATA | BDRV_BLOCK_ALLOCATED |
+                             BDRV_BLOCK_OFFSET_VALID);
+    g_assert_cmpint(pnum, ==, 1024 * 1024);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* a range inside the first one is answered from the cache */
+    ret = bdrv_block_status(bs, 4096, 8192, &pnum, &map, &file);
+    g_assert_cmpint(ret, ==, BDRV_BLOCK_DATA | BDRV_BLOCK_ALLOCATED |
+                             BDRV_BLOCK_OFFSET_VALID);
+    g_assert_cmpint(pnum, ==, 8192);
+    g_assert_cmpint(map, ==, 4096);
+    g_assert(file == bs);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* the tail of a cached range is clamped to what was cached */
+    bdrv_block_status(bs, 1024 * 1024 - 4096, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(pnum, ==, 4096);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* past it, the driver is asked again */
+    bdrv_block_status(bs, 1024 * 1024, 4096, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 2);
+
+    blk_unref(blk);
+}
+
+static void test_invalidate(void)
+{
+    BlockDriverState *bs, *file;
+    BlockBackend *blk = test_setup(&bs, BLK_PERM_ALL);
+    BDRVTestState *s = bs->opaque;
+    int64_t pnum, map;
+    uint8_t buf[4096] = { 0 };
+
+    s->status = BDRV_BLOCK_DATA;
+
+    bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* a write elsewhere leaves the cached range alone */
+    blk_pwrite(blk, 2 * 1024 * 1024, buf, sizeof(buf), 0);
+    bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* a write to the range drops it */
+    blk_pwrite(blk, 512 * 1024, buf, sizeof(buf), 0);
+    bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 2);
+
+    /* and so does a drained section */
+    bdrv_drained_begin(bs);
+    bdrv_drained_end(bs);
+    bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 3);
+
+    blk_unref(blk);
+}
+
+static void test_make_empty(void)
+{
+    BlockDriverState *bs, *file;
+    BlockBackend *blk = test_setup(&bs, BLK_PERM_ALL);
+    BDRVTestState *s = bs->opaque;
+    int64_t pnum, map;
+    int ret;
+
+    s->status = BDRV_BLOCK_DATA;
+
+    bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(s->block_status_calls, ==, 1);
+
+    /* emptying the node bypasses the write path, but drops the cache */
+    g_assert_cmpint(bdrv_make_empty(bs), ==, 0);
+    ret = bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(ret & BDRV_BLOCK_DATA, ==, 0);
+    g_assert_cmpint(s->block_status_calls, ==, 2);
+
+    blk_unref(blk);
+}
+
+static void test_outside_write(void)
+{
+    BlockDriverState *bs, *file;
+    BlockBackend *blk = test_setup(&bs, BLK_PERM_ALL & ~BLK_PERM_WRITE);
+    BDRVTestState *s = bs->opaque;
+    int64_t pnum, map;
+    int ret;
+
+    /*
+     * Nobody in QEMU shares the node, but something outside QEMU writes
+     * to it behind our back: zeroes and holes must not be cached.
+     */
+    s->status = BDRV_BLOCK_ZERO;
+    ret = bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(ret & BDRV_BLOCK_ZERO, ==, BDRV_BLOCK_ZERO);
+    s->status = BDRV_BLOCK_DATA;
+    ret = bdrv_block_status(bs, 0, 1024 * 1024, &pnum, &map, &file);
+    g_assert_cmpint(ret & (BDRV_BLOCK_DATA | BDRV_BLOCK_ZERO), ==,
+                    BDRV_BLOCK_DATA);
+    g_assert_cmpint(s->block_status_calls, ==, 2);
+
+    s->status = 0;
+    ret = bdrv_block_status(bs, 2 * 1024 * 1024, 1024 * 1024, &pnum, &map,
+                            &file);
+    g_assert_cmpint(ret & BDRV_BLOCK_DATA, ==, 0);
+    s->status = BDRV_BLOCK_DATA;
+    ret = bdrv_block_status(bs, 2 * 1024 * 1024, 1024 * 1024, &pnum, &map,
+                            &file);
+    g_assert_cmpint(ret & BDRV_BLOCK_DATA, ==, BDRV_BLOCK_DATA);
+    g_assert_cmpint(s->block_status_calls, ==, 4);
+
+    blk_unref(blk);
+}
+
+int main(int argc, char **argv)
+{
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/block-status-cache/hit", test_hit);
+    g_test_add_func("/block-status-cache/invalidate", test_invalidate);
+    g_test_add_func("/block-status-cache/make-empty", test_make_empty);
+    g_test_add_func("/block-status-cache/outside-write",
+                    test_outside_write);
+
+    return g_test_run();
+}
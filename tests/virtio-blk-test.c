@@ -344,6 +344,23 @@ static void basic(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/*
+ * Queue 1 is handled by iothread1, while the BlockBackend lives in the
+ * AioContext of iothread0, which handles queue 0.
+ */
+static void iothread_vq_mapping(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtQueue *vq0, *vq1;
+
+    vq0 = qvirtqueue_setup(blk_if->vdev, t_alloc, 0);
+    vq1 = qvirtqueue_setup(blk_if->vdev, t_alloc, 1);
+    test_basic(blk_if->vdev, t_alloc, vq1);
+    qvirtqueue_cleanup(blk_if->vdev->bus, vq1, t_alloc);
+    qvirtqueue_cleanup(blk_if->vdev->bus, vq0, t_alloc);
+}
+
 static void indirect(void *obj, void *u_data, QGuestAllocator *t_alloc)
 {
     QVirtQueue *vq;
@@ -769,6 +786,14 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_test_setup_iothreads(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -object iothread,id=iothread0"
+                    " -object iothread,id=iothread1");
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -786,6 +811,15 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.before = virtio_blk_test_setup_iothreads;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "num-queues=2,len-iothread-vq-mapping=2,"
+                             "iothread-vq-mapping[0]=iothread0,"
+                             "iothread-vq-mapping[1]=iothread1",
+    };
+    qos_add_test("iothread-vq-mapping", "virtio-blk-pci",
+                 iothread_vq_mapping, &opts);
 }
 
 libqos_init(register_virtio_blk_test);
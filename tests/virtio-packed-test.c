@@ -0,0 +1,431 @@
+/*
+ * QTest testcase for packed virtqueues
+ *
+ * Drives virtio-blk through a packed ring over modern virtio-pci, which
+ * is the only transport that can negotiate VIRTIO_F_RING_PACKED.  The
+ * ring is smaller than usual and its size is not a multiple of the three
+ * descriptors of a request, so chains wrap around the end of the ring
+ * and both wrap counters flip many times.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "libqos/libqos-pc.h"
+#include "libqos/pci.h"
+#include "hw/pci/pci_regs.h"
+#include "standard-headers/linux/virtio_blk.h"
+#include "standard-headers/linux/virtio_config.h"
+#include "standard-headers/linux/virtio_pci.h"
+#include "standard-headers/linux/virtio_ring.h"
+
+#define PCI_SLOT_BLK        0x04
+#define QUEUE_SIZE          8
+#define REQ_DESCS           3
+#define SECTOR_SIZE         512
+#define TEST_IMAGE_SIZE     (64 * 1024)
+#define TIMEOUT_US          (30 * 1000 * 1000)
+#define DESC_SIZE           16
+
+typedef struct PackedDev {
+    QOSState *qs;
+    QPCIDevice *pdev;
+    QPCIBar bars[6];
+    int common_bar, notify_bar;
+    uint32_t common_off, notify_off;
+    uint32_t notify_mult;
+    uint16_t queue_notify_off;
+
+    /* the ring, as the driver sees it */
+    uint64_t desc;
+    uint16_t avail_idx;
+    bool avail_wrap;
+    uint16_t used_idx;
+    bool used_wrap;
+
+    /* one request header, data sector and status byte per buffer id */
+    uint64_t hdrs, data, status;
+} PackedDev;
+
+static char *tmp_path;
+static char *mig_socket;
+
+static void common_writeb(PackedDev *d, uint32_t reg, uint8_t val)
+{
+    qpci_io_writeb(d->pdev, d->bars[d->common_bar], d->common_off + reg, val);
+}
+
+static void common_writew(PackedDev *d, uint32_t reg, uint16_t val)
+{
+    qpci_io_writew(d->pdev, d->bars[d->common_bar], d->common_off + reg, val);
+}
+
+static void common_writel(PackedDev *d, uint32_t reg, uint32_t val)
+{
+    qpci_io_writel(d->pdev, d->bars[d->common_bar], d->common_off + reg, val);
+}
+
+static uint8_t common_readb(PackedDev *d, uint32_t reg)
+{
+    return qpci_io_readb(d->pdev, d->bars[d->common_bar],
+                         d->common_off + reg);
+}
+
+static uint16_t common_readw(PackedDev *d, uint32_t reg)
+{
+    return qpci_io_readw(d->pdev, d->bars[d->common_bar],
+                         d->common_off + reg);
+}
+
+static uint32_t common_readl(PackedDev *d, uint32_t reg)
+{
+    return qpci_io_readl(d->pdev, d->bars[d->common_bar],
+                         d->common_off + reg);
+}
+
+static void common_writeq(PackedDev *d, uint32_t reg, uint64_t val)
+{
+    common_writel(d, reg, val);
+    common_writel(d, reg + 4, val >> 32);
+}
+
+static QPCIDevice *find_device(QOSState *qs)
+{
+    QPCIDevice *pdev;
+
+    pdev = qpci_device_find(qs->pcibus, QPCI_DEVFN(PCI_SLOT_BLK, 0));
+    g_assert(pdev != NULL);
+    qpci_device_enable(pdev);
+    return pdev;
+}
+
+/* Find the common and notify configuration structures */
+static void find_caps(PackedDev *d)
+{
+    bool mapped[6] = { false };
+    uint8_t cap;
+
+    d->common_bar = d->notify_bar = -1;
+    for (cap = qpci_config_readb(d->pdev, PCI_CAPABILITY_LIST); cap;
+         cap = qpci_config_readb(d->pdev, cap + PCI_CAP_LIST_NEXT)) {
+        uint8_t type, bar;
+        uint32_t offset;
+
+        if (qpci_config_readb(d->pdev, cap + PCI_CAP_LIST_ID) !=
+            PCI_CAP_ID_VNDR) {
+            continue;
+        }
+        type = qpci_config_readb(d->pdev, cap + VIRTIO_PCI_CAP_CFG_TYPE);
+        bar = qpci_config_readb(d->pdev, cap + VIRTIO_PCI_CAP_BAR);
+        offset = qpci_config_readl(d->pdev, cap + VIRTIO_PCI_CAP_OFFSET);
+
+        if (type == VIRTIO_PCI_CAP_COMMON_CFG && d->common_bar < 0) {
+            d->common_bar = bar;
+            d->common_off = offset;
+        } else if (type == VIRTIO_PCI_CAP_NOTIFY_CFG && d->notify_bar < 0) {
+            d->notify_bar = bar;
+            d->notify_off = offset;
+            d->notify_mult = qpci_config_readl(d->pdev, cap +
+                                               sizeof(struct virtio_pci_cap));
+        } else {
+            continue;
+        }
+        g_assert_cmpint(bar, <, 6);
+        if (!mapped[bar]) {
+            d->bars[bar] = qpci_iomap(d->pdev, bar, NULL);
+            mapped[bar] = true;
+        }
+    }
+    g_assert_cmpint(d->common_bar, >=, 0);
+    g_assert_cmpint(d->notify_bar, >=, 0);
+}
+
+static void packed_dev_init(PackedDev *d, QOSState *qs)
+{
+    QTestState *qts = qs->qts;
+    uint64_t driver_event, device_event;
+    uint8_t status;
+
+    memset(d, 0, sizeof(*d));
+    d->qs = qs;
+    d->pdev = find_device(qs);
+    find_caps(d);
+
+    common_writeb(d, VIRTIO_PCI_COMMON_STATUS, 0);
+    status = VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER;
+    common_writeb(d, VIRTIO_PCI_COMMON_STATUS, status);
+
+    /* Only accept what is needed for a packed ring */
+    common_writel(d, VIRTIO_PCI_COMMON_DFSELECT, 1);
+    g_assert(common_readl(d, VIRTIO_PCI_COMMON_DF) &
+             (1u << (VIRTIO_F_RING_PACKED - 32)));
+    common_writel(d, VIRTIO_PCI_COMMON_GFSELECT, 0);
+    common_writel(d, VIRTIO_PCI_COMMON_GF, 0);
+    common_writel(d, VIRTIO_PCI_COMMON_GFSELECT, 1);
+    common_writel(d, VIRTIO_PCI_COMMON_GF,
+                  (1u << (VIRTIO_F_VERSION_1 - 32)) |
+                  (1u << (VIRTIO_F_RING_PACKED - 32)));
+    status |= VIRTIO_CONFIG_S_FEATURES_OK;
+    common_writeb(d, VIRTIO_PCI_COMMON_STATUS, status);
+    g_assert(common_readb(d, VIRTIO_PCI_COMMON_STATUS) &
+             VIRTIO_CONFIG_S_FEATURES_OK);
+
+    d->desc = guest_alloc(&qs->alloc, QUEUE_SIZE * DESC_SIZE);
+    driver_event = guest_alloc(&qs->alloc, 4);
+    device_event = guest_alloc(&qs->alloc, 4);
+    qtest_memset(qts, d->desc, 0, QUEUE_SIZE * DESC_SIZE);
+    qtest_memset(qts, driver_event, 0, 4);
+    qtest_memset(qts, device_event, 0, 4);
+    d->avail_wrap = d->used_wrap = true;
+
+    d->hdrs = guest_alloc(&qs->alloc, QUEUE_SIZE * 16);
+    d->data = guest_alloc(&qs->alloc, QUEUE_SIZE * SECTOR_SIZE);
+    d->status = guest_alloc(&qs->alloc, QUEUE_SIZE);
+
+    common_writew(d, VIRTIO_PCI_COMMON_Q_SELECT, 0);
+    common_writew(d, VIRTIO_PCI_COMMON_Q_SIZE, QUEUE_SIZE);
+    common_writeq(d, VIRTIO_PCI_COMMON_Q_DESCLO, d->desc);
+    common_writeq(d, VIRTIO_PCI_COMMON_Q_AVAILLO, driver_event);
+    common_writeq(d, VIRTIO_PCI_COMMON_Q_USEDLO, device_event);
+    d->queue_notify_off = common_readw(d, VIRTIO_PCI_COMMON_Q_NOFF);
+    common_writew(d, VIRTIO_PCI_COMMON_Q_ENABLE, 1);
+
+    status |= VIRTIO_CONFIG_S_DRIVER_OK;
+    common_writeb(d, VIRTIO_PCI_COMMON_STATUS, status);
+}
+
+/* The avail and used flags of a descriptor made available with @wrap */
+static uint16_t avail_flags(bool wrap)
+{
+    return wrap ? 1 << VRING_PACKED_DESC_F_AVAIL
+                : 1 << VRING_PACKED_DESC_F_USED;
+}
+
+/*
+ * Make a virtio-blk request available with buffer id @id.  The flags of
+ * the head descriptor are written last, so that the device never sees a
+ * partial chain.
+ */
+static void submit_req(PackedDev *d, uint16_t id, uint32_t type,
+                       uint64_t sector)
+{
+    QTestState *qts = d->qs->qts;
+    uint64_t hdr = d->hdrs + id * 16;
+    const struct {
+        uint64_t addr;
+        uint32_t len;
+        uint16_t flags;
+    } chain[REQ_DESCS] = {
+        { hdr, 16, VRING_DESC_F_NEXT },
+        { d->data + id * SECTOR_SIZE, SECTOR_SIZE, VRING_DESC_F_NEXT |
+          (type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0) },
+        { d->status + id, 1, VRING_DESC_F_WRITE },
+    };
+    uint64_t head = d->desc + d->avail_idx * DESC_SIZE;
+    uint16_t head_flags = 0;
+    int i;
+
+    qtest_writel(qts, hdr, type);
+    qtest_writel(qts, hdr + 4, 0);
+    qtest_writeq(qts, hdr + 8, sector);
+    qtest_writeb(qts, d->status + id, 0xff);
+
+    for (i = 0; i < REQ_DESCS; i++) {
+        uint64_t desc = d->desc + d->avail_idx * DESC_SIZE;
+        uint16_t flags = chain[i].flags | avail_flags(d->avail_wrap);
+
+        qtest_writeq(qts, desc, chain[i].addr);
+        qtest_writel(qts, desc + 8, chain[i].len);
+        qtest_writew(qts, desc + 12, id);
+        if (i == 0) {
+            head_flags = flags;
+        } else {
+            qtest_writew(qts, desc + 14, flags);
+        }
+
+        if (++d->avail_idx == QUEUE_SIZE) {
+            d->avail_idx = 0;
+            d->avail_wrap = !d->avail_wrap;
+        }
+    }
+    qtest_writew(qts, head + 14, head_flags);
+}
+
+static void kick(PackedDev *d)
+{
+    qpci_io_writew(d->pdev, d->bars[d->notify_bar],
+                   d->notify_off + d->queue_notify_off * d->notify_mult, 0);
+}
+
+/* Wait for the next used descriptor and return its buffer id */
+static uint16_t wait_used(PackedDev *d)
+{
+    QTestState *qts = d->qs->qts;
+    uint64_t desc = d->desc + d->used_idx * DESC_SIZE;
+    gint64 start_time = g_get_monotonic_time();
+    uint16_t flags, id;
+
+    for (;;) {
+        bool avail, used;
+
+        flags = qtest_readw(qts, desc + 14);
+        avail = flags & (1 << VRING_PACKED_DESC_F_AVAIL);
+        used = flags & (1 << VRING_PACKED_DESC_F_USED);
+        if (avail == d->used_wrap && used == d->used_wrap) {
+            break;
+        }
+        qtest_clock_step(qts, 100);
+        g_assert(g_get_monotonic_time() - start_time <= TIMEOUT_US);
+    }
+
+    id = qtest_readw(qts, desc + 12);
+    g_assert_cmpint(id, <, QUEUE_SIZE);
+    g_assert_cmpint(qtest_readb(qts, d->status + id), ==, VIRTIO_BLK_S_OK);
+
+    /* The used descriptor stands for the whole chain */
+    d->used_idx += REQ_DESCS;
+    if (d->used_idx >= QUEUE_SIZE) {
+        d->used_idx -= QUEUE_SIZE;
+        d->used_wrap = !d->used_wrap;
+    }
+    return id;
+}
+
+static void write_sector(PackedDev *d, uint64_t sector, uint8_t pattern)
+{
+    qtest_memset(d->qs->qts, d->data, pattern, SECTOR_SIZE);
+    submit_req(d, 0, VIRTIO_BLK_T_OUT, sector);
+    kick(d);
+    g_assert_cmpint(wait_used(d), ==, 0);
+}
+
+static void check_data(PackedDev *d, uint16_t id, uint8_t pattern)
+{
+    uint8_t buf[SECTOR_SIZE], expected[SECTOR_SIZE];
+
+    memset(expected, pattern, SECTOR_SIZE);
+    qtest_memread(d->qs->qts, d->data + id * SECTOR_SIZE, buf, SECTOR_SIZE);
+    g_assert(!memcmp(buf, expected, SECTOR_SIZE));
+}
+
+static void check_sector(PackedDev *d, uint64_t sector, uint8_t pattern)
+{
+    submit_req(d, 0, VIRTIO_BLK_T_IN, sector);
+    kick(d);
+    g_assert_cmpint(wait_used(d), ==, 0);
+    check_data(d, 0, pattern);
+}
+
+static QOSState *boot(const char *extra)
+{
+    return qtest_pc_boot("-drive if=none,id=drive0,file=%s,format=raw "
+                         "-device virtio-blk-pci,drive=drive0,addr=%x.0,"
+                         "disable-legacy=on,packed=on %s",
+                         tmp_path, PCI_SLOT_BLK, extra);
+}
+
+static void test_wrap(void)
+{
+    QOSState *qs = boot("");
+    PackedDev d;
+    int i;
+
+    packed_dev_init(&d, qs);
+
+    /* One request at a time, across many wrap-arounds */
+    for (i = 0; i < 4 * QUEUE_SIZE; i++) {
+        write_sector(&d, i, i + 1);
+    }
+    for (i = 0; i < 4 * QUEUE_SIZE; i++) {
+        check_sector(&d, i, i + 1);
+    }
+
+    /* Two requests in flight, completed in any order */
+    for (i = 0; i < 2 * QUEUE_SIZE; i++) {
+        uint16_t id1, id2;
+
+        submit_req(&d, 1, VIRTIO_BLK_T_IN, i);
+        submit_req(&d, 2, VIRTIO_BLK_T_IN, i + 1);
+        kick(&d);
+        id1 = wait_used(&d);
+        id2 = wait_used(&d);
+        g_assert((id1 == 1 && id2 == 2) || (id1 == 2 && id2 == 1));
+        check_data(&d, 1, i + 1);
+        check_data(&d, 2, i + 2);
+    }
+
+    qtest_shutdown(qs);
+}
+
+static void test_migrate(void)
+{
+    char *uri = g_strdup_printf("unix:%s", mig_socket);
+    char *incoming = g_strdup_printf("-incoming %s", uri);
+    QOSState *src, *dst;
+    PackedDev d;
+    int i;
+
+    src = boot("");
+    dst = boot(incoming);
+    packed_dev_init(&d, src);
+
+    /* Leave the ring with both wrap counters flipped */
+    for (i = 0; i < 3; i++) {
+        write_sector(&d, i, 0x40 + i);
+    }
+    g_assert(!d.avail_wrap && !d.used_wrap);
+
+    migrate(src, dst, uri);
+
+    /* The destination must carry on where the source left off */
+    d.qs = dst;
+    d.pdev = qpci_device_find(dst->pcibus, QPCI_DEVFN(PCI_SLOT_BLK, 0));
+    g_assert(d.pdev != NULL);
+    for (i = 0; i < 3; i++) {
+        check_sector(&d, i, 0x40 + i);
+    }
+    for (i = 3; i < 2 * QUEUE_SIZE; i++) {
+        write_sector(&d, i, 0x40 + i);
+        check_sector(&d, i, 0x40 + i);
+    }
+
+    qtest_shutdown(src);
+    qtest_shutdown(dst);
+    g_free(incoming);
+    g_free(uri);
+}
+
+int main(int argc, char **argv)
+{
+    const char *arch = qtest_get_arch();
+    int fd, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (strcmp(arch, "i386") && strcmp(arch, "x86_64")) {
+        return 0;
+    }
+
+    tmp_path = g_strdup("/tmp/qtest.XXXXXX");
+    fd = mkstemp(tmp_path);
+    g_assert_cmpint(fd, >=, 0);
+    ret = ftruncate(fd, TEST_IMAGE_SIZE);
+    g_assert_cmpint(ret, ==, 0);
+    close(fd);
+
+    mig_socket = g_strdup_printf("%s/qtest-packed-%d.sock",
+                                 g_get_tmp_dir(), getpid());
+
+    qtest_add_func("/virtio/packed/wrap", test_wrap);
+    qtest_add_func("/virtio/packed/migrate", test_migrate);
+
+    ret = g_test_run();
+
+    unlink(tmp_path);
+    g_free(tmp_path);
+    unlink(mig_socket);
+    g_free(mig_socket);
+    return ret;
+}
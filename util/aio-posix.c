@@ -35,6 +35,10 @@ struct AioHandler
     void *opaque;
     bool is_external;
     QLIST_ENTRY(AioHandler) node;
+#ifdef CONFIG_LINUX_IO_URING
+    QSLIST_ENTRY(AioHandler) node_submitted;
+    unsigned flags; /* FDMON_IO_URING_* */
+#endif
 };
 
 #ifdef CONFIG_EPOLL_CREATE1
@@ -186,6 +190,278 @@ static bool aio_epoll_check_poll(AioContext *ctx, GPollFD *pfds,
 
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+
+/*
+ * io_uring fd monitoring.  Instead of handing the whole set of file
+ * descriptors to ppoll(2) on every iteration, or issuing epoll_ctl(2) for each
+ * handler change, an IORING_OP_POLL_ADD request is kept in flight for every
+ * AioHandler.  Handler changes and re-arming of completed polls are queued as
+ * sqes and submitted together with the wait, so a single io_uring_enter(2)
+ * call both updates the monitored set and blocks for events.
+ *
+ * AioHandler->flags tracks the state of a handler with respect to the ring.
+ * It is updated with atomics because aio_set_fd_handler() can run in another
+ * thread, but only the thread running aio_poll() submits sqes and reaps cqes.
+ */
+
+/* The ring size, the cq ring is twice as large */
+#define FDMON_IO_URING_ENTRIES  128
+
+enum {
+    FDMON_IO_URING_PENDING  = (1 << 0), /* on ctx->submit_list */
+    FDMON_IO_URING_ADD      = (1 << 1), /* IORING_OP_POLL_ADD needed */
+    FDMON_IO_URING_REMOVE   = (1 << 2), /* IORING_OP_POLL_REMOVE needed */
+    FDMON_IO_URING_ARMED    = (1 << 3), /* IORING_OP_POLL_ADD in flight */
+};
+
+static void aio_io_uring_enqueue(AioContext *ctx, AioHandler *node,
+                                 unsigned flags)
+{
+    unsigned old_flags;
+
+    old_flags = atomic_fetch_or(&node->flags, FDMON_IO_URING_PENDING | flags);
+    if (!(old_flags & FDMON_IO_URING_PENDING)) {
+        QSLIST_INSERT_HEAD_ATOMIC(&ctx->submit_list, node, node_submitted);
+    }
+}
+
+static void aio_io_uring_update(AioContext *ctx, AioHandler *old_node,
+                                AioHandler *new_node)
+{
+    if (!atomic_read(&ctx->io_uring_available)) {
+        return;
+    }
+
+    if (new_node) {
+        aio_io_uring_enqueue(ctx, new_node, FDMON_IO_URING_ADD);
+    }
+
+    if (old_node) {
+        /*
+         * The node must stay around until its IORING_OP_POLL_ADD, if any, has
+         * been cancelled.  aio_node_can_free() checks that.
+         */
+        aio_io_uring_enqueue(ctx, old_node, FDMON_IO_URING_REMOVE);
+    }
+}
+
+/*
+ * A node can only be freed once the ring no longer references it, i.e. when
+ * it is neither waiting on submit_list nor has a poll request in flight.
+ */
+static bool aio_node_can_free(AioContext *ctx, AioHandler *node)
+{
+    return !atomic_read(&ctx->io_uring_available) ||
+           !(atomic_read(&node->flags) &
+             (FDMON_IO_URING_PENDING | FDMON_IO_URING_ARMED));
+}
+
+static struct io_uring_sqe *aio_io_uring_get_sqe(AioContext *ctx)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    int ret;
+
+    if (likely(sqe)) {
+        return sqe;
+    }
+
+    /* No free sqes left, submit pending sqes first */
+    do {
+        ret = io_uring_submit(ring);
+    } while (ret == -EINTR);
+
+    assert(ret > 0);
+    sqe = io_uring_get_sqe(ring);
+    assert(sqe);
+    return sqe;
+}
+
+/* Atomically enqueue a POLL_ADD sqe for @node */
+static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
+{
+    struct io_uring_sqe *sqe = aio_io_uring_get_sqe(ctx);
+
+    atomic_or(&node->flags, FDMON_IO_URING_ARMED);
+    /* G_IO_* and POLL* values are identical on Linux */
+    io_uring_prep_poll_add(sqe, node->pfd.fd, node->pfd.events);
+    io_uring_sqe_set_data(sqe, node);
+}
+
+static void add_poll_remove_sqe(AioContext *ctx, AioHandler *node)
+{
+    struct io_uring_sqe *sqe = aio_io_uring_get_sqe(ctx);
+
+    /* The poll request to cancel is identified by its user_data */
+    io_uring_prep_rw(IORING_OP_POLL_REMOVE, sqe, -1, NULL, 0, 0);
+    sqe->addr = (uintptr_t)node;
+    io_uring_sqe_set_data(sqe, NULL);
+}
+
+/*
+ * Add a timeout that self-cancels when another cqe becomes ready.  The kernel
+ * reads @ts at submission time, so it must stay valid until then.
+ */
+static void add_timeout_sqe(AioContext *ctx, struct __kernel_timespec *ts)
+{
+    struct io_uring_sqe *sqe = aio_io_uring_get_sqe(ctx);
+
+    io_uring_prep_timeout(sqe, ts, 1, 0);
+    io_uring_sqe_set_data(sqe, NULL);
+}
+
+/* Add sqes from ctx->submit_list for submission */
+static void fill_sq_ring(AioContext *ctx)
+{
+    QSLIST_HEAD(, AioHandler) submit_list;
+    AioHandler *node;
+    unsigned flags;
+
+    QSLIST_MOVE_ATOMIC(&submit_list, &ctx->submit_list);
+
+    while ((node = QSLIST_FIRST(&submit_list))) {
+        QSLIST_REMOVE_HEAD(&submit_list, node_submitted);
+
+        /* Order matters, just in case both flags were set */
+        flags = atomic_fetch_and(&node->flags, ~(FDMON_IO_URING_PENDING |
+                                                 FDMON_IO_URING_ADD |
+                                                 FDMON_IO_URING_REMOVE));
+
+        if (flags & FDMON_IO_URING_REMOVE) {
+            if (flags & FDMON_IO_URING_ARMED) {
+                add_poll_remove_sqe(ctx, node);
+            }
+        } else if (flags & FDMON_IO_URING_ADD) {
+            add_poll_add_sqe(ctx, node);
+        }
+    }
+}
+
+/*
+ * Reap cqes and fill in pfd.revents.  Returns the number of handlers that
+ * need to go through aio_dispatch_handlers(), either because they are ready
+ * or because they were deleted and can now be freed.
+ */
+static int process_cq_ring(AioContext *ctx)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct io_uring_cqe *cqe;
+    unsigned num_cqes = 0;
+    unsigned num_ready = 0;
+    unsigned head;
+
+    io_uring_for_each_cqe(ring, head, cqe) {
+        AioHandler *node = io_uring_cqe_get_data(cqe);
+
+        num_cqes++;
+
+        /* Timeout and poll remove sqes have no AioHandler */
+        if (!node) {
+            continue;
+        }
+
+        atomic_and(&node->flags, ~FDMON_IO_URING_ARMED);
+        num_ready++;
+
+        if (node->deleted || cqe->res == -ECANCELED) {
+            /* aio_dispatch_handlers() frees the node if it was deleted */
+            continue;
+        }
+
+        node->pfd.revents |= cqe->res < 0 ? G_IO_ERR : cqe->res;
+
+        /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
+        add_poll_add_sqe(ctx, node);
+    }
+
+    io_uring_cq_advance(ring, num_cqes);
+    return num_ready;
+}
+
+static int aio_io_uring_wait(AioContext *ctx, int64_t timeout)
+{
+    unsigned wait_nr = 1; /* block until at least one cqe is ready */
+    struct __kernel_timespec ts;
+    int ret;
+
+    if (timeout == 0) {
+        wait_nr = 0; /* non-blocking */
+    } else if (timeout > 0) {
+        ts.tv_sec = timeout / NANOSECONDS_PER_SECOND;
+        ts.tv_nsec = timeout % NANOSECONDS_PER_SECOND;
+        add_timeout_sqe(ctx, &ts);
+    }
+
+    fill_sq_ring(ctx);
+
+    do {
+        ret = io_uring_submit_and_wait(&ctx->fdmon_io_uring, wait_nr);
+    } while (ret == -EINTR);
+
+    assert(ret >= 0);
+
+    return process_cq_ring(ctx);
+}
+
+static bool aio_io_uring_enabled(AioContext *ctx)
+{
+    /*
+     * Fall back to ppoll when external clients are disabled, otherwise
+     * re-armed polls for ignored handlers would complete immediately again.
+     */
+    return atomic_read(&ctx->io_uring_available) &&
+           !aio_external_disabled(ctx);
+}
+
+static void aio_io_uring_setup(AioContext *ctx)
+{
+    int ret;
+
+    QSLIST_INIT(&ctx->submit_list);
+    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+    ctx->io_uring_available = (ret == 0);
+}
+
+/*
+ * Once the ring is gone no node is referenced by it anymore, so
+ * aio_node_can_free() ignores the FDMON_IO_URING_* flags from then on.
+ * Must be called from the thread that runs aio_poll().
+ */
+static void aio_io_uring_destroy(AioContext *ctx)
+{
+    if (!ctx->io_uring_available) {
+        return;
+    }
+
+    atomic_set(&ctx->io_uring_available, false);
+    io_uring_queue_exit(&ctx->fdmon_io_uring);
+}
+
+#else
+
+static void aio_io_uring_update(AioContext *ctx, AioHandler *old_node,
+                                AioHandler *new_node)
+{
+}
+
+static bool aio_node_can_free(AioContext *ctx, AioHandler *node)
+{
+    return true;
+}
+
+static int aio_io_uring_wait(AioContext *ctx, int64_t timeout)
+{
+    assert(false);
+}
+
+static bool aio_io_uring_enabled(AioContext *ctx)
+{
+    return false;
+}
+
+#endif
+
 static AioHandler *find_aio_handler(AioContext *ctx, int fd)
 {
     AioHandler *node;
@@ -210,8 +486,12 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
         g_source_remove_poll(&ctx->source, &node->pfd);
     }
 
-    /* If a read is in progress, just mark the node as deleted */
-    if (qemu_lockcnt_count(&ctx->list_lock)) {
+    /*
+     * If a read is in progress or io_uring still references the node, just
+     * mark the node as deleted
+     */
+    if (qemu_lockcnt_count(&ctx->list_lock) ||
+        !aio_node_can_free(ctx, node)) {
         node->deleted = 1;
         node->pfd.revents = 0;
         return false;
@@ -279,6 +559,7 @@ void aio_set_fd_handler(AioContext *ctx,
 
         QLIST_INSERT_HEAD_RCU(&ctx->aio_handlers, new_node, node);
     }
+    aio_io_uring_update(ctx, node, new_node);
     if (node) {
         deleted = aio_remove_fd_handler(ctx, node);
     }
@@ -377,6 +658,14 @@ bool aio_prepare(AioContext *ctx)
     /* Poll mode cannot be used with glib's event loop, disable it. */
     poll_set_started(ctx, false);
 
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * Neither can io_uring: glib polls the file descriptors itself, and
+     * nothing would reap the completions or free the nodes they reference.
+     */
+    aio_io_uring_destroy(ctx);
+#endif
+
     return false;
 }
 
@@ -441,7 +730,7 @@ static bool aio_dispatch_handlers(AioContext *ctx)
             progress = true;
         }
 
-        if (node->deleted) {
+        if (node->deleted && aio_node_can_free(ctx, node)) {
             if (qemu_lockcnt_dec_if_lock(&ctx->list_lock)) {
                 QLIST_REMOVE(node, node);
                 g_free(node);
@@ -643,11 +932,17 @@ bool aio_poll(AioContext *ctx, bool blocking)
      * system call---a single round of run_poll_handlers_once suffices.
      */
     if (timeout || atomic_read(&ctx->poll_disable_cnt)) {
+        /*
+         * aio_disable_external() can flip this at any time; the pollfds
+         * must be filled for exactly the wait that is done below.
+         */
+        bool use_io_uring = aio_io_uring_enabled(ctx);
+
         assert(npfd == 0);
 
         /* fill pollfds */
 
-        if (!aio_epoll_enabled(ctx)) {
+        if (!use_io_uring && !aio_epoll_enabled(ctx)) {
             QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
                 if (!node->deleted && node->pfd.events
                     && aio_node_check(ctx, node->is_external)) {
@@ -657,7 +952,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
         }
 
         /* wait until next event */
-        if (aio_epoll_check_poll(ctx, pollfds, npfd, timeout)) {
+        if (use_io_uring) {
+            ret = aio_io_uring_wait(ctx, timeout);
+        } else if (aio_epoll_check_poll(ctx, pollfds, npfd, timeout)) {
             AioHandler epoll_handler;
 
             epoll_handler.pfd.fd = ctx->epollfd;
@@ -740,6 +1037,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
 void aio_context_setup(AioContext *ctx)
 {
+#ifdef CONFIG_LINUX_IO_URING
+    aio_io_uring_setup(ctx);
+#endif
 #ifdef CONFIG_EPOLL_CREATE1
     assert(!ctx->epollfd);
     ctx->epollfd = epoll_create1(EPOLL_CLOEXEC);
@@ -754,6 +1054,19 @@ void aio_context_setup(AioContext *ctx)
 
 void aio_context_destroy(AioContext *ctx)
 {
+#ifdef CONFIG_LINUX_IO_URING
+    AioHandler *node, *tmp;
+
+    aio_io_uring_destroy(ctx);
+
+    /* Free nodes that were kept around only for the ring */
+    QLIST_FOREACH_SAFE(node, &ctx->aio_handlers, node, tmp) {
+        if (node->deleted) {
+            QLIST_REMOVE(node, node);
+            g_free(node);
+        }
+    }
+#endif
 #ifdef CONFIG_EPOLL_CREATE1
     aio_epoll_disable(ctx);
 #endif
@@ -130,6 +130,7 @@ int main(int argc, char **argv)
 #include "qapi/qmp/qerror.h"
 #include "sysemu/iothread.h"
 #include "qemu/guest-random.h"
+#include "qemu/plugin.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -305,6 +306,16 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "superblocks",
+            .type = QEMU_OPT_BOOL,
+            .help = "Retranslate hot chains of TBs as superblocks",
+        },
+        {
+            .name = "direct-ram",
+            .type = QEMU_OPT_BOOL,
+            .help = "Let loads with physical addresses bypass the TLB",
+        },
         { /* end of list */ }
     },
 };
@@ -2896,6 +2907,7 @@ int main(int argc, char **argv, char **envp)
     const char *log_mask = NULL;
     const char *log_file = NULL;
     char *trace_file = NULL;
+    QemuPluginList plugin_list = QTAILQ_HEAD_INITIALIZER(plugin_list);
     ram_addr_t maxram_size;
     uint64_t ram_slots = 0;
     FILE *vmstate_dump_file = NULL;
@@ -2919,6 +2931,7 @@ int main(int argc, char **argv, char **envp)
     qemu_init_exec_dir(argv[0]);
 
     module_call_init(MODULE_INIT_QOM);
+    module_call_init(MODULE_INIT_MIGRATION);
 
     qemu_add_opts(&qemu_drive_opts);
     qemu_add_drive_opts(&qemu_legacy_drive_opts);
@@ -2934,6 +2947,7 @@ int main(int argc, char **argv, char **envp)
     qemu_add_opts(&qemu_global_opts);
     qemu_add_opts(&qemu_mon_opts);
     qemu_add_opts(&qemu_trace_opts);
+    qemu_plugin_add_opts();
     qemu_add_opts(&qemu_option_rom_opts);
     qemu_add_opts(&qemu_machine_opts);
     qemu_add_opts(&qemu_accel_opts);
@@ -3712,6 +3726,9 @@ int main(int argc, char **argv, char **envp)
                 g_free(trace_file);
                 trace_file = trace_opt_parse(optarg);
                 break;
+            case QEMU_OPTION_plugin:
+                qemu_plugin_opt_parse(optarg, &plugin_list);
+                break;
             case QEMU_OPTION_readconfig:
                 {
                     int ret = qemu_read_config_file(optarg);
@@ -4016,6 +4033,11 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
 
+    /* plugins may want to know the number of vCPUs, so load them here */
+    if (qemu_plugin_load_list(&plugin_list)) {
+        exit(1);
+    }
+
     /*
      * Get the default machine options from the machine if it is not already
      * specified either by the configuration file or by the command line.